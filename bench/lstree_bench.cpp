@@ -0,0 +1,323 @@
+#include "../include/argparse.hpp"
+#include "../include/byte_search.hpp"
+#include "../include/directory_tree.hpp"
+#include "../include/entry_sort.hpp"
+#include "../include/ignore_matcher.hpp"
+#include "../include/output_buffer.hpp"
+#include "../include/tree_renderer.hpp"
+#include "../include/uring_walker.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * @struct SyntheticTree
+ * @brief A generated tree shape, with its size at scale 1.
+ */
+struct SyntheticTree {
+    const char* name;
+    std::function<void(const fs::path&, unsigned int)> generate;
+};
+
+/**
+ * @brief Creates an empty file.
+ */
+void touch(const fs::path& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0) close(fd);
+}
+
+/**
+ * @brief Creates a directory holding a number of files.
+ */
+void make_directory(const fs::path& path, unsigned int file_count, const string& prefix = "file_") {
+    fs::create_directories(path);
+    char name[32];
+    for (unsigned int i = 0; i < file_count; i++) {
+        std::snprintf(name, sizeof(name), "%06u", i);
+        touch(path / (prefix + name));
+    }
+}
+
+// Breadth: 400 directories of 25 files below the root.
+void generate_wide(const fs::path& root, unsigned int scale) {
+    for (unsigned int i = 0; i < 400 * scale; i++)
+        make_directory(root / ("dir_" + std::to_string(i)), 25);
+}
+
+// Depth: a chain of 256 directories with 4 files each.
+void generate_deep(const fs::path& root, unsigned int scale) {
+    fs::path path = root;
+    for (unsigned int i = 0; i < 256 * scale; i++) {
+        path /= "level_" + std::to_string(i);
+        make_directory(path, 4);
+    }
+}
+
+// Many small directories: a fan-out of 20 x 20 x (10 * scale), two files each.
+void generate_small_directories(const fs::path& root, unsigned int scale) {
+    for (unsigned int i = 0; i < 20; i++)
+        for (unsigned int j = 0; j < 20; j++)
+            for (unsigned int k = 0; k < 10 * scale; k++)
+                make_directory(root / ("a" + std::to_string(i)) / ("b" + std::to_string(j))
+                    / ("c" + std::to_string(k)), 2);
+}
+
+// One huge directory of 100,000 files.
+void generate_huge_directory(const fs::path& root, unsigned int scale) {
+    make_directory(root, 100000 * scale);
+}
+
+// Long names: 20,000 files whose names share a 200-byte prefix.
+void generate_long_names(const fs::path& root, unsigned int scale) {
+    make_directory(root, 20000 * scale, string(200, 'n') + "_");
+}
+
+const SyntheticTree SYNTHETIC_TREES[] = {
+    {"wide", generate_wide},
+    {"deep", generate_deep},
+    {"small_dirs", generate_small_directories},
+    {"huge_dir", generate_huge_directory},
+    {"long_names", generate_long_names},
+};
+
+/**
+ * @brief Generates a tree unless a complete one is already there.
+ */
+fs::path prepare_tree(const fs::path& base, const SyntheticTree& tree, unsigned int scale) {
+    fs::path root = base / ("scale_" + std::to_string(scale)) / tree.name;
+    fs::path marker = root.string() + ".complete";
+    if (fs::exists(marker)) return root;
+    fs::remove_all(root);
+    cerr << "Generating " << root.string() << endl;
+    tree.generate(root, scale);
+    touch(marker);
+    return root;
+}
+
+/**
+ * @brief The fastest of several runs of a stage, in seconds.
+ *
+ * @param prepare Called, untimed, before every run, or empty.
+ */
+double time_stage(
+    unsigned int repeat,
+    const std::function<void()>& stage,
+    const std::function<void()>& prepare = {}
+) {
+    double best = 0;
+    for (unsigned int i = 0; i < repeat; i++) {
+        if (prepare) prepare();
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+/**
+ * @brief Writes one result as an NDJSON record.
+ */
+void report(
+    OutputBuffer& results,
+    const char* tree,
+    const char* stage,
+    const string& configuration,
+    size_t entries,
+    double seconds
+) {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+        "{\"tree\":\"%s\",\"stage\":\"%s\",%s\"entries\":%zu,\"seconds\":%.6f}",
+        tree, stage, configuration.c_str(), entries, seconds);
+    results.write_line(line);
+    results.flush();
+}
+
+/**
+ * @brief The entries of every directory of a tree, as the walker lists them.
+ */
+vector<vector<ListedEntry>> directory_listings(const DirectoryTree& tree) {
+    vector<vector<ListedEntry>> listings;
+    // Subtree ends and listings of the directories being walked
+    vector<std::pair<uint64_t, size_t>> open_directories;
+    const auto& nodes = tree.nodes();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        while (!open_directories.empty() && open_directories.back().first <= i)
+            open_directories.pop_back();
+        const DirectoryTree::Node& node = nodes[i];
+        if (node.kind == DirectoryTree::NodeKind::OMITTED) continue;
+        bool is_directory = node.kind == DirectoryTree::NodeKind::DIRECTORY;
+        if (!open_directories.empty())
+            listings[open_directories.back().second].push_back(make_listed_entry(tree.name(node),
+                is_directory ? EntryType::DIRECTORY : EntryType::REGULAR_FILE));
+        if (is_directory && node.opened) {
+            open_directories.push_back({node.subtree_end, listings.size()});
+            listings.emplace_back();
+        }
+    }
+    return listings;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    argparse::ArgumentParser program("lstree_bench", "1.0");
+    program.add_argument("--dir")
+        .default_value(string("/tmp/lstree-bench"))
+        .help("Where the synthetic trees are generated and kept between runs.");
+    program.add_argument("--scale")
+        .default_value(1)
+        .scan<'i', int>() // Parse as integer
+        .help("Size multiplier of the synthetic trees. Defaults to 1.");
+    program.add_argument("--repeat")
+        .default_value(3)
+        .scan<'i', int>() // Parse as integer
+        .help("Runs per measurement; the fastest one is reported. Defaults to 3.");
+    try {
+        program.parse_args(argc, argv);
+    } catch (const std::runtime_error& err) {
+        cerr << "Error: " << err.what() << endl;
+        cerr << program;
+        return 1;
+    }
+    fs::path base = program.get<string>("--dir");
+    int scale = program.get<int>("--scale");
+    int repeat = program.get<int>("--repeat");
+    if (scale < 1 || repeat < 1) {
+        cerr << "Error: --scale and --repeat must be positive." << endl;
+        return 1;
+    }
+    vector<unsigned int> thread_counts = {1, 2, 4};
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    if (cores > 4) thread_counts.push_back(cores);
+    vector<std::pair<const char*, ReadBackend>> backends = {{"std", ReadBackend::STD_FILESYSTEM}};
+    if (getdents_backend_available())
+        backends.push_back({"getdents", ReadBackend::GETDENTS});
+
+    OutputBuffer results;
+    for (const SyntheticTree& synthetic : SYNTHETIC_TREES) {
+        string root = prepare_tree(base, synthetic, scale).string();
+        HierarchyOptions options;
+        options.sort_entries = false;
+        // Traversal: reading every directory into a tree, per backend and thread count
+        DirectoryTree tree;
+        for (const auto& [backend_name, backend] : backends) {
+            options.backend = backend;
+            for (unsigned int threads : thread_counts) {
+                double seconds = time_stage(repeat, [&] {
+                    tree = build_directory_tree(root, options, threads);
+                });
+                report(results, synthetic.name, "traversal",
+                    "\"backend\":\"" + string(backend_name) + "\",\"threads\":"
+                        + std::to_string(threads) + ",",
+                    tree.nodes().size(), seconds);
+            }
+        }
+        // The io_uring engine, when the kernel has it
+        string walked_root = root;
+        DirectoryTree uring_tree;
+        bool uring_available = true;
+        double uring_seconds = time_stage(repeat, [&] {
+            uring_tree = DirectoryTree();
+            DirectoryTreeBuilder builder(uring_tree, 0);
+            HierarchyState state(builder);
+            uring_available = generate_directory_hierarchy_uring(walked_root, options, state);
+        });
+        if (uring_available)
+            report(results, synthetic.name, "traversal",
+                "\"backend\":\"getdents\",\"engine\":\"uring\",\"threads\":1,",
+                uring_tree.nodes().size(), uring_seconds);
+        // Sorting: every directory's entries by name, as the walker sorts them
+        vector<vector<ListedEntry>> listings = directory_listings(tree);
+        vector<vector<ListedEntry>> unsorted;
+        double sort_seconds = time_stage(repeat,
+            [&] {
+                for (auto& listing : unsorted)
+                    sort_entries_by_name(listing);
+            },
+            [&] { unsorted = listings; }
+        );
+        report(results, synthetic.name, "sort", "", tree.nodes().size(), sort_seconds);
+        // Matching: --ignore style patterns over every listing, batched and per name
+        IgnoreMatcher matcher({"*cache*", "*.tmp", "node_*", "*lock*"});
+        vector<uint8_t> matched;
+        size_t match_count = 0;
+        double batch_seconds = time_stage(repeat, [&] {
+            match_count = 0;
+            for (const auto& listing : listings) {
+                matcher.match_entries(listing, matched);
+                match_count += std::count(matched.begin(), matched.end(), 1);
+            }
+        });
+        report(results, synthetic.name, "match",
+            "\"kernel\":\"" + string(search_kernel_name(search_kernel())) + "\",\"batched\":true,",
+            tree.nodes().size(), batch_seconds);
+        double name_seconds = time_stage(repeat, [&] {
+            match_count = 0;
+            for (const auto& listing : listings)
+                for (const auto& entry : listing)
+                    match_count += matcher.matches(entry.name);
+        });
+        report(results, synthetic.name, "match",
+            "\"kernel\":\"" + string(search_kernel_name(search_kernel())) + "\",\"batched\":false,",
+            tree.nodes().size(), name_seconds);
+        // Rendering: formatting every line, into a buffer that writes to /dev/null
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        for (OutputFormat format : {OutputFormat::TEXT, OutputFormat::JSON, OutputFormat::BINARY}) {
+            const char* format_name = format == OutputFormat::TEXT ? "text"
+                : format == OutputFormat::JSON ? "json" : "bin";
+            double seconds = time_stage(repeat, [&] {
+                OutputBuffer output(null_fd);
+                std::unique_ptr<TreeEmitter> emitter = make_tree_emitter(format, output, options);
+                emit_directory_tree(tree, *emitter);
+            });
+            report(results, synthetic.name, "render",
+                "\"format\":\"" + string(format_name) + "\",", tree.nodes().size(), seconds);
+        }
+        close(null_fd);
+        // Output: writing the rendered text to a regular file
+        fs::path rendered = base / "rendered.txt";
+        {
+            int fd = open(rendered.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            OutputBuffer output(fd);
+            TreeRenderer renderer(output, options.x_spacing, options.y_spacing);
+            emit_directory_tree(tree, renderer);
+            output.flush();
+            close(fd);
+        }
+        std::ifstream input(rendered, std::ios::binary);
+        string text((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        double output_seconds = time_stage(repeat, [&] {
+            int fd = open(rendered.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            {
+                OutputBuffer output(fd);
+                output.write(text);
+            }
+            close(fd);
+        });
+        report(results, synthetic.name, "output", "\"bytes\":" + std::to_string(text.size()) + ",",
+            tree.nodes().size(), output_seconds);
+        fs::remove(rendered);
+    }
+    return 0;
+}
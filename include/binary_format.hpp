@@ -0,0 +1,74 @@
+#pragma once
+
+#include "tree_emitter.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * @class BinaryEmitter
+ * @brief Writes the tree as a compact binary dump.
+ *
+ * Layout, all integers unsigned LEB128 varints unless noted:
+ *
+ *   "LSTB" version:u8
+ *   record*                         the tree in print order
+ *   summary record
+ *   index: count, then count (start, end) pairs as little-endian u64
+ *   trailer: index offset as little-endian u64, then "LSTBIDX1"
+ *
+ * An entry record is a tag byte (kind, last, opened, link, has-metadata
+ * bits), the depth, the length of the prefix shared with the previous
+ * sibling's name, the length and bytes of the rest of the name, for a link
+ * the length and bytes of its target, and optionally the size and the
+ * zigzag-encoded mtime in seconds. Version 1 dumps have no links. An "opened" directory is
+ * followed by its entries. The index holds the byte range of every opened
+ * directory's record and subtree, so readers mapping the file can skip
+ * whole subtrees: names are front-coded against siblings only, and the
+ * first entry of a directory shares nothing.
+ */
+class BinaryEmitter : public TreeEmitter {
+public:
+    explicit BinaryEmitter(OutputBuffer& output);
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void begin_entries(unsigned int depth) override;
+    void end_entries() override;
+    void write_omitted(size_t omitted_count, unsigned int depth) override;
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return METADATA_SIZE | METADATA_MTIME; }
+
+private:
+    void flush_directory(bool opened);
+    void write_record(uint8_t tag);
+    void encode_name(std::string_view name, unsigned int depth);
+
+    OutputBuffer& sink;
+    std::string record;                 ///< Record being encoded, reused.
+    uint64_t offset = 0;                ///< Bytes written so far.
+    std::vector<std::string> previous_names; ///< Last name written per depth.
+    // The last directory is held back until it is known whether its entries follow
+    bool directory_pending = false;
+    uint8_t pending_tag = 0;
+    std::string pending_body;
+    std::vector<size_t> open_directories; ///< Index slots of the directories being listed.
+    std::vector<std::pair<uint64_t, uint64_t>> index;
+};
+
+// Function Declarations
+bool render_binary_tree(const std::string& path, TreeEmitter& emitter);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @enum SearchKernel
+ * @brief Instruction set find_bytes() runs on, picked once per process.
+ */
+enum class SearchKernel {
+    SCALAR, ///< Portable loop around memchr.
+    AVX2,   ///< 32 candidate positions per step (x86-64 with AVX2).
+    NEON    ///< 16 candidate positions per step (AArch64).
+};
+
+// Function Declarations
+size_t find_bytes(std::string_view haystack, std::string_view needle, size_t from = 0);
+SearchKernel search_kernel();
+const char* search_kernel_name(SearchKernel kernel);
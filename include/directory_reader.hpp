@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum ReadBackend
+ * @brief How directories are opened and enumerated.
+ */
+enum class ReadBackend {
+    STD_FILESYSTEM, ///< std::filesystem::directory_iterator on full paths.
+    GETDENTS        ///< Linux only: openat() relative to the parent fd plus raw getdents64.
+};
+
+/**
+ * @class NameArena
+ * @brief Owns the bytes that the string_views of a listing point into.
+ *
+ * Names are either copied into append-only blocks or, for the
+ * getdents backend, left where the kernel wrote them by adopting the whole
+ * read buffer. Blocks never move, so views stay valid for the arena's life.
+ */
+class NameArena {
+public:
+    /**
+     * @brief Copies a name into the arena.
+     *
+     * @return A view of the stored copy.
+     */
+    std::string_view store(std::string_view name);
+
+    /**
+     * @brief Takes ownership of a buffer that names already point into.
+     */
+    void adopt(std::unique_ptr<char[]> block);
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* block_cursor = nullptr;
+    size_t block_capacity = 0;
+    size_t block_remaining = 0;
+};
+
+/**
+ * @enum EntryType
+ * @brief Kind of a listed entry, after following symlinks when asked to.
+ */
+enum class EntryType : uint8_t {
+    REGULAR_FILE,
+    DIRECTORY,
+    UNRESOLVED, ///< DT_UNKNOWN; resolve_entry_type() decides.
+    SYMLINK     ///< A symlink that is shown as a link; resolve_entry_type() may follow it.
+};
+
+/**
+ * @struct ListedEntry
+ * @brief A directory entry that survived filtering and will be printed.
+ *
+ * Kept small (40 bytes) so that sorting moves little memory. The name bytes
+ * live in the listing's NameArena.
+ */
+struct ListedEntry {
+    uint64_t sort_key = 0;   ///< First 8 name bytes, big-endian; see compute_sort_key().
+    std::string_view name;   ///< File name of the entry, owned by the listing.
+    uint64_t inode = 0;      ///< Inode number, or 0 when the backend does not report it.
+    EntryType type = EntryType::REGULAR_FILE; ///< File, directory or not yet known.
+
+    bool is_directory() const { return type == EntryType::DIRECTORY; }
+    bool is_link() const { return type == EntryType::SYMLINK; }
+};
+
+/**
+ * @enum MetadataField
+ * @brief Bits selecting which EntryMetadata fields are read.
+ */
+enum MetadataField : unsigned int {
+    METADATA_SIZE = 1 << 0,  ///< EntryMetadata::size.
+    METADATA_MTIME = 1 << 1, ///< EntryMetadata::mtime_ns.
+    METADATA_OWNER = 1 << 2, ///< EntryMetadata::owner.
+    METADATA_IDENTITY = 1 << 3, ///< EntryMetadata::device and inode.
+    METADATA_FILES = 1 << 4  ///< EntryMetadata::file_count; set by --du only.
+};
+
+/**
+ * @struct EntryMetadata
+ * @brief Per-entry details that cost a stat and are only read on request.
+ */
+struct EntryMetadata {
+    uint64_t size = 0;     ///< Size in bytes; a symlink listed as a link reports its own.
+    int64_t mtime_ns = 0;  ///< Last modification, in nanoseconds since the epoch.
+    uint64_t device = 0;   ///< Device holding the entry.
+    uint64_t inode = 0;    ///< Inode number on that device.
+    uint64_t file_count = 0; ///< Files below a directory, with --du.
+    uint32_t owner = 0;    ///< User id of the owner.
+    unsigned int fields = 0; ///< MetadataField bits of the fields that were read.
+};
+
+/**
+ * @struct DirectoryListing
+ * @brief The filtered (and optionally sorted) entries of one directory.
+ */
+struct DirectoryListing {
+    std::vector<ListedEntry> entries;
+    NameArena names;
+    std::vector<EntryMetadata> metadata; ///< One per entry when requested, otherwise empty.
+    std::vector<std::string_view> link_targets; ///< One per entry when any is a link, otherwise empty.
+    size_t omitted_count = 0; ///< Entries left out by --max-entries-per-dir.
+};
+
+/**
+ * @class OpenDirectory
+ * @brief A directory the walker can read and descend from.
+ *
+ * The std::filesystem backend only carries the full path. The getdents
+ * backend carries an open descriptor instead, so subdirectories are opened
+ * relative to it and their paths are never rebuilt or resolved again.
+ */
+class OpenDirectory {
+public:
+    OpenDirectory() = default;
+    OpenDirectory(std::string path, int fd) : path(std::move(path)), fd(fd) {}
+    ~OpenDirectory();
+
+    OpenDirectory(OpenDirectory&& other) noexcept;
+    OpenDirectory& operator=(OpenDirectory&& other) noexcept;
+    OpenDirectory(const OpenDirectory&) = delete;
+    OpenDirectory& operator=(const OpenDirectory&) = delete;
+
+    std::string path; ///< Full path; empty below the root for the getdents backend, unless detached.
+    int fd = -1;      ///< Open descriptor, or -1 for the std::filesystem backend.
+};
+
+/**
+ * @class DirectoryCursor
+ * @brief Reads the entries of an open directory one at a time.
+ *
+ * Holds a single small read buffer (or a directory_iterator), so streaming
+ * a directory costs the same memory whatever its size. Returns the same
+ * entries, with the same types, as read_directory_entries() without a
+ * filter. The name of a returned entry is NUL-terminated and only valid
+ * until the next call to next().
+ */
+class DirectoryCursor {
+public:
+    DirectoryCursor(const OpenDirectory& directory, ReadBackend backend);
+
+    /**
+     * @brief Reads the next file, directory or unresolved entry.
+     *
+     * @param entry Receives the entry.
+     * @return false once the directory is exhausted.
+     */
+    bool next(ListedEntry& entry);
+
+private:
+    static constexpr size_t BUFFER_SIZE = 32 * 1024;
+
+    const OpenDirectory& directory;
+    ReadBackend backend;
+    std::filesystem::directory_iterator iterator;
+    std::string current_name;       ///< Name storage for the std::filesystem backend.
+    std::unique_ptr<char[]> buffer; ///< getdents64 records of the current read.
+    long buffer_size = 0;
+    long buffer_offset = 0;
+};
+
+// Decides from its name whether an entry is kept.
+using EntryFilter = std::function<bool(std::string_view)>;
+
+// Function Declarations
+OpenDirectory open_root_directory(const std::string& path, ReadBackend backend);
+OpenDirectory open_subdirectory(
+    const OpenDirectory& parent,
+    std::string_view name,
+    ReadBackend backend
+);
+size_t open_directory_limit();
+bool release_directory(OpenDirectory& directory, const OpenDirectory& subdirectory);
+void reacquire_directory(OpenDirectory& directory, const OpenDirectory& subdirectory);
+bool detach_directory(OpenDirectory& directory);
+bool read_directory_entries(
+    const OpenDirectory& directory,
+    ReadBackend backend,
+    const EntryFilter& keep,
+    DirectoryListing& listing,
+    size_t max_entries = 0
+);
+bool resolve_entry_type(const OpenDirectory& directory, ListedEntry& entry, bool follow_links);
+bool read_link_target(const OpenDirectory& directory, std::string_view name, std::string& target);
+void read_link_targets(const OpenDirectory& directory, DirectoryListing& listing);
+bool directory_identity(const OpenDirectory& directory, uint64_t& device, uint64_t& inode);
+bool read_directory_file(
+    const OpenDirectory& directory,
+    std::string_view name,
+    std::string& contents
+);
+bool getdents_backend_available();
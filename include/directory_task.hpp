@@ -0,0 +1,95 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @struct DirectoryTask
+ * @brief One directory read ahead of the printer, plus the tasks of its subdirectories.
+ *
+ * Shared by the engines that read directories out of print order (the
+ * thread pool and io_uring) and print them through render_directory_task().
+ * The k-th subdirectory task belongs to the k-th directory entry of the
+ * listing, which is how the printer finds it again. A task keeps its parent
+ * directory only until it has opened its own, so a directory is closed
+ * once all of its subdirectories have been opened.
+ */
+struct DirectoryTask {
+    std::string name;
+    std::shared_ptr<const OpenDirectory> parent_directory;
+    std::shared_ptr<OpenDirectory> directory; ///< A root the engine opened itself, if any.
+    std::shared_ptr<const GitignoreScope> parent_gitignore;
+    std::shared_ptr<const GitignoreScope> gitignore;
+    DirectoryListing listing;
+    std::vector<std::shared_ptr<DirectoryTask>> subdirectories;
+    std::exception_ptr error;
+    std::atomic<int> status{0}; ///< Lifecycle, in the states of the engine running it.
+    int open_result = -1;       ///< Descriptor, or -errno, of an open made by the engine.
+    unsigned int depth;
+
+    DirectoryTask(
+        std::string task_name,
+        std::shared_ptr<const OpenDirectory> parent,
+        unsigned int task_depth
+    ) : name(std::move(task_name)),
+        parent_directory(std::move(parent)),
+        depth(task_depth) {}
+};
+
+/**
+ * @class DescriptorBudget
+ * @brief Bounds the directories kept open for subdirectory tasks.
+ *
+ * A directory stays open until all of its subdirectories were opened,
+ * which takes long when the readers run far ahead of the printer. Past the
+ * budget, a directory is detached instead, see detach_directory(), and its
+ * subdirectories are opened by path.
+ */
+class DescriptorBudget {
+public:
+    explicit DescriptorBudget(size_t limit) : available(limit) {}
+
+    /**
+     * @brief Takes one descriptor from the budget, unless it is used up.
+     */
+    bool try_hold() {
+        size_t count = available.load(std::memory_order_relaxed);
+        while (count > 0)
+            if (available.compare_exchange_weak(count, count - 1, std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+
+    void release() {
+        available.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<size_t> available;
+};
+
+// Opens the directory of a task that has a parent; the engine's own step.
+using SubdirectoryOpener = std::function<OpenDirectory(const DirectoryTask&)>;
+// Blocks until a task's listing (or error) is available.
+using DirectoryTaskWaiter = std::function<void(DirectoryTask&)>;
+
+// Function Declarations
+void read_directory_task(
+    DirectoryTask& task,
+    const HierarchyOptions& options,
+    const SubdirectoryOpener& open_directory,
+    const std::shared_ptr<DescriptorBudget>& budget
+);
+void render_directory_task(
+    const std::shared_ptr<DirectoryTask>& root,
+    unsigned int depth,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    const DirectoryTaskWaiter& wait_for,
+    const SubdirectoryLeaver& released = {}
+);
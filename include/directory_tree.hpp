@@ -0,0 +1,128 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include "tree_emitter.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class DirectoryTree
+ * @brief A walked tree held in memory, independent of any output format.
+ *
+ * Nodes sit in one flat array in print order (depth-first, entries in
+ * listing order), each knowing where its subtree ends, so whole subtrees
+ * are skipped by index. All names are stored back to back in one string
+ * pool. The tree is filled by a DirectoryTreeBuilder from any walker and
+ * printed, as often as needed and in any format, by emit_directory_tree().
+ */
+class DirectoryTree {
+public:
+    enum class NodeKind : uint8_t {
+        FILE,
+        DIRECTORY,
+        OMITTED, ///< The "… (N more)" entry of a directory cut off by --max-entries-per-dir.
+        LINK     ///< A symlink shown as a link; its target follows its name in the pool.
+    };
+
+    /**
+     * @struct Node
+     * @brief One entry of the tree.
+     */
+    struct Node {
+        uint64_t name_offset = 0;  ///< Start of the name in the pool; the count of an OMITTED node.
+        uint64_t subtree_end = 0;  ///< Index one past the node's last descendant.
+        uint32_t name_length = 0;
+        uint32_t target_length = 0; ///< Length of a LINK node's target.
+        uint32_t depth = 0;
+        NodeKind kind = NodeKind::FILE;
+        bool is_last = false;      ///< Whether no sibling follows.
+        bool opened = false;       ///< Whether the directory's entries were walked.
+    };
+
+    const std::vector<Node>& nodes() const { return node_array; }
+
+    std::string_view name(const Node& node) const {
+        return std::string_view(names).substr(node.name_offset, node.name_length);
+    }
+
+    /**
+     * @brief Where a LINK node points; empty for other nodes.
+     */
+    std::string_view target(const Node& node) const {
+        return std::string_view(names).substr(node.name_offset + node.name_length, node.target_length);
+    }
+
+    /**
+     * @brief The metadata of a node, or nullptr if the tree carries none.
+     */
+    const EntryMetadata* metadata(size_t index) const {
+        return entry_metadata.empty() ? nullptr : &entry_metadata[index];
+    }
+    EntryMetadata* metadata(size_t index) {
+        return entry_metadata.empty() ? nullptr : &entry_metadata[index];
+    }
+
+    unsigned int directory_count = 0; ///< Totals of the summary line.
+    unsigned int file_count = 0;
+
+private:
+    friend class DirectoryTreeBuilder;
+
+    std::vector<Node> node_array;
+    std::string names;
+    std::vector<EntryMetadata> entry_metadata; ///< One per node when requested, otherwise empty.
+};
+
+/**
+ * @class DirectoryTreeBuilder
+ * @brief Emitter filling a DirectoryTree with whatever a walker emits.
+ */
+class DirectoryTreeBuilder : public TreeEmitter {
+public:
+    /**
+     * @param tree The tree to fill; should be empty.
+     * @param fields The MetadataField bits the tree keeps for every node.
+     */
+    DirectoryTreeBuilder(DirectoryTree& tree, unsigned int fields) : tree(tree), fields(fields) {}
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void begin_entries(unsigned int depth) override;
+    void end_entries() override;
+    void write_omitted(size_t omitted_count, unsigned int depth) override;
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return fields; }
+
+private:
+    void add_node(const DirectoryTree::Node& node, const EntryMetadata* metadata);
+
+    DirectoryTree& tree;
+    unsigned int fields;
+    std::vector<size_t> open_directories; ///< Nodes of the directories being walked.
+};
+
+// Function Declarations
+void emit_directory_tree(
+    const DirectoryTree& tree,
+    TreeEmitter& emitter,
+    unsigned int max_depth = 0
+);
+DirectoryTree build_directory_tree(
+    std::string path,
+    const HierarchyOptions& options,
+    unsigned int thread_count = 1
+);
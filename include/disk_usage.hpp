@@ -0,0 +1,70 @@
+#pragma once
+
+#include "directory_tree.hpp"
+#include "inode_set.hpp"
+#include "tree_emitter.hpp"
+#include <memory>
+
+/**
+ * @class DiskUsageEmitter
+ * @brief Gives every directory the total size and file count of its subtree.
+ *
+ * A directory's total is only known once its whole subtree was walked, but
+ * it is printed before its entries, so the tree is collected into a
+ * DirectoryTree as it arrives and printed through the wrapped emitter,
+ * with the totals, when the summary comes. Every file is counted once per
+ * (device, inode), so further hard links to it add no bytes. A symlink
+ * shown as a link adds its own size (the length of its target path); only
+ * with --follow-links does it stand for, and dedup against, its target.
+ *
+ * The walk ignores --max-depth when --du is set, so totals always cover
+ * the whole tree; the levels past the limit are simply not printed.
+ * --max-entries-per-dir drops entries before they could be counted, so
+ * main() rejects it together with --du.
+ */
+class DiskUsageEmitter : public TreeEmitter {
+public:
+    /**
+     * @param inner The emitter writing the output format.
+     * @param max_depth The deepest level whose entries are printed; 0 = no limit.
+     */
+    DiskUsageEmitter(std::unique_ptr<TreeEmitter> inner, unsigned int max_depth)
+        : inner(std::move(inner)),
+          max_depth(max_depth),
+          builder(tree, this->inner->metadata_fields() | METADATA_SIZE | METADATA_IDENTITY) {}
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override {
+        builder.write_entry(name, depth, is_directory, is_last, metadata);
+    }
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override {
+        builder.write_link(name, target, depth, is_last, metadata);
+    }
+    void begin_entries(unsigned int depth) override { builder.begin_entries(depth); }
+    void end_entries() override { builder.end_entries(); }
+    void write_omitted(size_t omitted_count, unsigned int depth) override {
+        builder.write_omitted(omitted_count, depth);
+    }
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return builder.metadata_fields(); }
+
+private:
+    std::unique_ptr<TreeEmitter> inner;
+    unsigned int max_depth;
+    DirectoryTree tree;
+    DirectoryTreeBuilder builder;
+};
+
+// Function Declarations
+void add_subtree_totals(DirectoryTree& tree);
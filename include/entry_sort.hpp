@@ -0,0 +1,39 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Packs the first 8 bytes of a name into an integer sort key.
+ *
+ * Bytes are stored big-endian and short names are padded with zeros, so
+ * comparing two keys orders names exactly like comparing their first 8
+ * bytes as unsigned chars (the order of std::string's operator<). Names
+ * with equal keys are told apart by their remaining bytes.
+ */
+inline uint64_t compute_sort_key(std::string_view name) {
+    unsigned char bytes[8] = {};
+    std::memcpy(bytes, name.data(), name.size() < 8 ? name.size() : 8);
+    uint64_t key = 0;
+    for (unsigned char byte : bytes)
+        key = (key << 8) | byte;
+    return key;
+}
+
+/**
+ * @brief Builds a listed entry with its sort key filled in.
+ */
+inline ListedEntry make_listed_entry(
+    std::string_view name,
+    EntryType type,
+    uint64_t inode = 0
+) {
+    return ListedEntry{compute_sort_key(name), name, inode, type};
+}
+
+// Function Declarations
+bool entry_name_less(const ListedEntry& a, const ListedEntry& b);
+void sort_entries_by_name(std::vector<ListedEntry>& entries);
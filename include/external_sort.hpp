@@ -0,0 +1,97 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ExternalSort
+ * @brief The entries of a directory too large to sort in one piece, in name order.
+ *
+ * The directory is read in chunks of HierarchyOptions::sort_chunk_entries
+ * raw entries. Each chunk is filtered like any listing, then sorted into a
+ * run on a second thread while the next chunk is read. Runs stay in memory
+ * until they would take more than HierarchyOptions::sort_memory bytes;
+ * later runs are spilled to an anonymous temporary file. The runs are then
+ * merged with a heap, one window of entries at a time, so the walker
+ * never holds more than a window of the merged listing.
+ */
+class ExternalSort {
+public:
+    ExternalSort(const HierarchyOptions& options, const GitignoreScope* gitignore);
+    ~ExternalSort();
+
+    ExternalSort(const ExternalSort&) = delete;
+    ExternalSort& operator=(const ExternalSort&) = delete;
+
+    /**
+     * @brief Sorts the entries read so far and reads the rest of the directory.
+     *
+     * @param directory The directory being read.
+     * @param first_chunk The raw entries read_directory_entries() stopped
+     * after; moved from.
+     */
+    void read_runs(const OpenDirectory& directory, DirectoryListing& first_chunk);
+
+    /**
+     * @brief Replaces a listing with the next entries in name order.
+     *
+     * The window gets its metadata and link targets like any listing, and
+     * the "… (N more)" count on the last window of a capped directory.
+     *
+     * @param directory The directory that was read; it may have moved since.
+     * @param window The listing to replace.
+     * @return false, leaving the window alone, once every entry has been handed out.
+     */
+    bool next_window(const OpenDirectory& directory, DirectoryListing& window);
+
+    /**
+     * @brief Whether next_window() has nothing left to hand out.
+     */
+    bool done() const { return finished; }
+
+private:
+    static constexpr size_t WINDOW_SIZE = 4096;
+    static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+    // A sorted chunk, held in memory or stored in the temporary file.
+    struct Run {
+        DirectoryListing listing;  ///< Entries while in memory.
+        uint64_t file_offset = 0;  ///< Start of the records once spilled.
+        uint64_t file_end = 0;
+        bool spilled = false;
+    };
+
+    // The merge position in a run.
+    struct RunCursor {
+        size_t run;
+        size_t index = 0;          ///< Next entry of an in-memory run.
+        uint64_t file_position = 0; ///< Next unread byte of a spilled run.
+        std::string buffer;        ///< Records read ahead from the file.
+        size_t buffer_offset = 0;
+        std::string name;          ///< Name of the current entry of a spilled run.
+        ListedEntry current;
+    };
+
+    void sort_run(const OpenDirectory& directory, std::unique_ptr<Run> run);
+    bool spill(Run& run);
+    bool advance(RunCursor& cursor);
+    void start_merge();
+
+    const HierarchyOptions& options;
+    const GitignoreScope* gitignore;
+    std::vector<std::unique_ptr<Run>> runs;
+    std::thread sorter;            ///< Sorts the previous chunk while the next is read.
+    size_t memory_used = 0;        ///< Bytes of the runs held in memory.
+    std::FILE* spill_file = nullptr;
+    uint64_t spill_size = 0;
+    std::vector<RunCursor> cursors;
+    std::vector<size_t> heap;      ///< Cursors with entries left, smallest first.
+    size_t total_count = 0;        ///< Listable entries over all runs.
+    size_t handed_out = 0;
+    bool finished = false;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include "ignore_matcher.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct GitignoreRule
+ * @brief One parsed line of a .gitignore (or .git/info/exclude) file.
+ */
+struct GitignoreRule {
+    std::vector<GlobPattern> segments; ///< Pattern split at '/'.
+    std::vector<bool> globstar;        ///< Whether a segment is "**".
+    bool negated = false;              ///< Line started with '!'.
+    bool directory_only = false;       ///< Line ended with '/'.
+    bool anchored = false;             ///< Matched against the path, not the name.
+};
+
+/**
+ * @class GitignoreScope
+ * @brief The .gitignore rules in effect for one directory of the walk.
+ *
+ * Scopes form an immutable chain that follows the recursion: each directory
+ * adds only the rules of its own .gitignore, parsed once when it is
+ * entered, on top of its parent's scope. Because scopes are never modified
+ * after creation, worker threads can share the chain.
+ */
+class GitignoreScope {
+public:
+    /**
+     * @brief Creates the scope of the walk's root directory.
+     *
+     * Loads .git/info/exclude, if present, below the root's .gitignore.
+     */
+    static std::shared_ptr<const GitignoreScope> open_root(const OpenDirectory& directory);
+
+    /**
+     * @brief Creates the scope of a subdirectory.
+     *
+     * @param parent The scope of the directory containing the subdirectory.
+     * @param directory The open subdirectory.
+     * @param name The subdirectory name.
+     */
+    static std::shared_ptr<const GitignoreScope> open_subdirectory(
+        const std::shared_ptr<const GitignoreScope>& parent,
+        const OpenDirectory& directory,
+        std::string_view name
+    );
+
+    /**
+     * @brief Whether an entry of this scope's directory is ignored.
+     *
+     * Deeper files take precedence over shallower ones and, within a file,
+     * the last matching line wins, as in git.
+     */
+    bool is_ignored(std::string_view name, bool is_directory) const;
+
+private:
+    void load_rules(const OpenDirectory& directory, std::string_view file_name);
+
+    std::shared_ptr<const GitignoreScope> parent;
+    std::string relative_path; ///< Directory path below the root, ending with '/' unless empty.
+    std::vector<GitignoreRule> rules;
+};
+
+// Function Declarations
+bool parse_gitignore_line(std::string_view line, GitignoreRule& rule);
+bool gitignore_rule_matches(
+    const GitignoreRule& rule,
+    std::string_view relative_path,
+    std::string_view name,
+    bool is_directory
+);
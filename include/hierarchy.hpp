@@ -0,0 +1,137 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include "gitignore.hpp"
+#include "ignore_matcher.hpp"
+#include "inode_set.hpp"
+#include "metadata_reader.hpp"
+#include "output_buffer.hpp"
+#include "run_stats.hpp"
+#include "snapshot_cache.hpp"
+#include "tree_emitter.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct HierarchyOptions
+ * @brief Settings shared by every directory of a single listing run.
+ */
+struct HierarchyOptions {
+    unsigned int x_spacing = 3;           ///< Number of spaces for horizontal padding.
+    unsigned int y_spacing = 1;           ///< Number of lines for vertical padding.
+    Charset charset = Charset::UTF8;      ///< Characters of the text format.
+    bool sort_entries = true;             ///< Whether to sort directory entries.
+    IgnoreMatcher ignore;                 ///< Compiled names and patterns to ignore.
+    IgnoreMatcher match;                  ///< Patterns files must match to be listed; empty = all.
+    bool use_gitignore = false;           ///< Whether .gitignore files prune the walk.
+    bool follow_links = false;            ///< Whether symlinks are listed as what they point to.
+    size_t sort_chunk_entries = 1 << 20;  ///< Directories with more entries are sorted in chunks; 0 = never.
+    size_t sort_memory = 256 << 20;       ///< Bytes of sorted chunks kept in memory before spilling.
+    unsigned int max_depth = 0;           ///< Deepest level whose entries are listed; 0 = no limit.
+    size_t max_entries_per_directory = 0; ///< Entries printed per directory; 0 = no limit.
+    ReadBackend backend = ReadBackend::STD_FILESYSTEM; ///< How directories are read.
+    unsigned int columns = 0;             ///< MetadataField bits shown as columns.
+    unsigned int metadata_fields = 0;     ///< MetadataField bits listings carry; 0 = none.
+    bool batch_metadata = false;          ///< Whether long listings are stat'ed through io_uring.
+    bool disk_usage = false;              ///< Whether directories show their subtree totals.
+    size_t top_entries = 0;               ///< Files reported by --top instead of the tree; 0 = off.
+    unsigned int top_field = METADATA_SIZE; ///< MetadataField that --top ranks files by.
+    RunStats* stats = nullptr;            ///< Collects the --stats report, or nullptr.
+};
+
+/**
+ * @struct HierarchyState
+ * @brief Mutable rendering state of a listing run.
+ *
+ * Owned by whoever prints the tree, so several runs (or a run driven by
+ * worker threads) never share process-wide counters.
+ */
+struct HierarchyState {
+    explicit HierarchyState(TreeEmitter& emitter) : emitter(emitter) {}
+
+    TreeEmitter& emitter;             ///< Receives the walked tree in print order.
+    unsigned int directory_count = 0; ///< Directories printed so far.
+    unsigned int file_count = 0;      ///< Files printed so far.
+    SnapshotCache* snapshot = nullptr; ///< Snapshot replaying unchanged directories, or nullptr.
+    InodeSet visited_directories;      ///< Directories entered, with --follow-links.
+};
+
+class ExternalSort;
+
+// Called after every subdirectory entry has been written, with its index
+// among the directories of its listing, to enter the subdirectory: returns
+// the subdirectory's listing, or nullptr to show it without entries.
+using SubdirectoryVisitor = std::function<const DirectoryListing*(const ListedEntry&, size_t)>;
+// Called once the entries of the subdirectory entered last are written.
+using SubdirectoryLeaver = std::function<void()>;
+
+/**
+ * @brief Whether the entries of a directory at a depth are listed.
+ */
+inline bool lists_entries_at(const HierarchyOptions& options, unsigned int depth) {
+    // Totals need the whole tree; DiskUsageEmitter hides the levels past the limit
+    if (options.disk_usage) return true;
+    return options.max_depth == 0 || depth < options.max_depth;
+}
+
+/**
+ * @brief Whether a classified entry passes --match, which only filters files.
+ */
+inline bool passes_match(const HierarchyOptions& options, const ListedEntry& entry) {
+    return entry.is_directory() || options.match.empty() || options.match.matches(entry.name);
+}
+
+// Function Declarations
+bool path_is_valid(
+    const std::string& path,
+    HierarchyState& state,
+    unsigned int depth
+);
+DirectoryListing read_directory_listing(
+    const OpenDirectory& directory,
+    const HierarchyOptions& options,
+    const GitignoreScope* gitignore = nullptr,
+    SnapshotCache* snapshot = nullptr,
+    std::unique_ptr<ExternalSort>* external = nullptr
+);
+void filter_directory_entries(
+    DirectoryListing& listing,
+    const OpenDirectory& directory,
+    const HierarchyOptions& options,
+    const GitignoreScope* gitignore
+);
+void print_directory_header(
+    std::string_view name,
+    HierarchyState& state,
+    unsigned int depth
+);
+void print_listed_entry(
+    const DirectoryListing& listing,
+    size_t index,
+    HierarchyState& state,
+    unsigned int depth,
+    bool is_last
+);
+bool enter_directory_once(const OpenDirectory& directory, HierarchyState& state);
+void print_omitted_entries(
+    size_t omitted_count,
+    HierarchyState& state,
+    unsigned int depth
+);
+void process_directory_entries(
+    const DirectoryListing& listing,
+    HierarchyState& state,
+    unsigned int depth,
+    const SubdirectoryVisitor& enter_subdirectory,
+    const SubdirectoryLeaver& leave_subdirectory
+);
+void generate_directory_hierarchy(
+    std::string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int depth = 0
+);
+void print_summary(HierarchyState& state);
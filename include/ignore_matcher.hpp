@@ -0,0 +1,103 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @class GlobPattern
+ * @brief A shell-style wildcard pattern compiled once for repeated matching.
+ *
+ * Supports '*', '?', bracket expressions ("[abc]", "[a-z]", "[!x]") and
+ * backslash escapes. Matching is on bytes and never allocates.
+ */
+class GlobPattern {
+public:
+    explicit GlobPattern(std::string_view pattern);
+
+    bool matches(std::string_view name) const;
+
+    /**
+     * @brief Whether a pattern contains any wildcard syntax at all.
+     */
+    static bool has_wildcards(std::string_view pattern);
+
+private:
+    enum TokenKind { LITERAL, ANY_CHAR, ANY_RUN, CHAR_CLASS };
+
+    struct Token {
+        TokenKind kind;
+        std::string text; ///< Literal bytes, or the class's byte ranges as pairs.
+        bool negated = false;
+    };
+
+    bool token_matches(const Token& token, std::string_view name, size_t& position) const;
+
+    std::vector<Token> tokens;
+};
+
+/**
+ * @class IgnoreMatcher
+ * @brief The compiled form of the --ignore (or --match) list.
+ *
+ * Plain names go into a hash set; "prefix*", "*suffix" and "*text*"
+ * patterns become literal byte searches; everything else is a GlobPattern.
+ * The --ignore matcher is consulted before an entry is classified, so an
+ * ignored directory is never stat'ed, opened or walked, at any depth.
+ */
+class IgnoreMatcher {
+public:
+    IgnoreMatcher() = default;
+    explicit IgnoreMatcher(const std::vector<std::string>& patterns);
+
+    bool matches(std::string_view name) const;
+
+    /**
+     * @brief Matches the names of a whole listing at once.
+     *
+     * Runs each rule over all names before the next rule. In larger
+     * listings of short names the names are joined into one buffer,
+     * separated by '/', which no name can contain, so each "*text*" rule
+     * is a single find_bytes() pass over the directory. Gives the same
+     * result as matches() for each entry.
+     *
+     * @param entries The entries to match.
+     * @param matched Receives 1 for every matching entry and 0 otherwise.
+     */
+    void match_entries(
+        const std::vector<ListedEntry>& entries,
+        std::vector<uint8_t>& matched
+    ) const;
+
+    bool empty() const {
+        return exact_names.empty() && prefixes.empty() && suffixes.empty()
+            && substrings.empty() && globs.empty();
+    }
+
+private:
+    // Listings at least this long, with names shorter than JOIN_NAME_LENGTH
+    // on average, have their names joined for substring rules.
+    static constexpr size_t JOIN_THRESHOLD = 16;
+    static constexpr size_t JOIN_NAME_LENGTH = 32;
+
+    void match_joined_substrings(
+        const std::vector<ListedEntry>& entries,
+        std::vector<uint8_t>& matched
+    ) const;
+
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+    std::unordered_set<std::string, NameHash, std::equal_to<>> exact_names;
+    std::vector<std::string> prefixes;
+    std::vector<std::string> suffixes;
+    std::vector<std::string> substrings;
+    std::vector<GlobPattern> globs;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class InodeSet
+ * @brief Set of (device, inode) pairs in one open-addressing table.
+ *
+ * Slots are 16 bytes and probed linearly, so a lookup usually touches a
+ * single cache line. Inode 0 marks empty slots; the few file systems that
+ * do hand it out have their pairs kept aside, one device per entry.
+ */
+class InodeSet {
+public:
+    /**
+     * @brief Adds a pair.
+     *
+     * @return false if the pair was already in the set.
+     */
+    bool insert(uint64_t device, uint64_t inode);
+
+    bool contains(uint64_t device, uint64_t inode) const;
+
+    size_t size() const { return count; }
+
+private:
+    struct Slot {
+        uint64_t device = 0;
+        uint64_t inode = 0; ///< 0 for an empty slot.
+    };
+
+    void grow();
+    size_t slot_index(uint64_t device, uint64_t inode) const;
+
+    std::vector<Slot> slots;
+    std::vector<uint64_t> zero_inode_devices; ///< Devices whose inode 0 is in the set.
+    size_t count = 0;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+/**
+ * @class IoUring
+ * @brief Minimal io_uring submission and completion queue pair.
+ *
+ * Talks to the kernel through the raw system calls, so no liburing is
+ * needed. A queue that fails to set up (old kernel, seccomp, another
+ * platform) reports !ready() and callers fall back to synchronous calls.
+ */
+class IoUring {
+public:
+    explicit IoUring(unsigned int entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool ready() const { return ring_fd >= 0; }
+
+    /// Number of submission slots.
+    unsigned int capacity() const { return sq_entries; }
+
+#ifdef __linux__
+    /**
+     * @brief Returns a zeroed submission entry, or nullptr when the queue is full.
+     */
+    io_uring_sqe* next_submission();
+
+    /**
+     * @brief Submits the queued entries and waits for at least some completions.
+     *
+     * @return false if the kernel rejected the submission; the queued
+     * entries are withdrawn then.
+     */
+    bool submit_and_wait(unsigned int wait_count);
+
+    /**
+     * @brief Takes the oldest completion, if any.
+     */
+    bool pop_completion(io_uring_cqe& completion);
+#endif
+
+private:
+    int ring_fd = -1;
+    unsigned int sq_entries = 0;
+    unsigned int pending = 0; ///< Entries queued but not yet submitted.
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    void* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned int* sq_head = nullptr;
+    unsigned int* sq_tail = nullptr;
+    unsigned int* sq_mask = nullptr;
+    unsigned int* sq_array = nullptr;
+    unsigned int* cq_head = nullptr;
+    unsigned int* cq_tail = nullptr;
+    unsigned int* cq_mask = nullptr;
+    void* cqes = nullptr;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "metadata_reader.hpp"
+#include "tree_emitter.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class JsonEmitter
+ * @brief Writes the tree as one JSON document, in the layout of `tree -J`.
+ *
+ * The document is an array holding the root directory, whose "contents"
+ * nest its entries, followed by a "report" object with the totals. Each
+ * entry is written straight into the output buffer as soon as it arrives,
+ * one per line, so nothing but the nesting depth is kept. Metadata is only
+ * added for the fields selected as columns, like `tree -J -s`.
+ */
+class JsonEmitter : public TreeEmitter {
+public:
+    /**
+     * @param fields The MetadataField bits added to every entry.
+     */
+    JsonEmitter(OutputBuffer& output, unsigned int fields) : sink(output), fields(fields) {}
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void begin_entries(unsigned int depth) override;
+    void end_entries() override;
+    void write_omitted(size_t omitted_count, unsigned int depth) override;
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return fields; }
+
+private:
+    void start_element(unsigned int depth);
+    void close_directory();
+
+    OutputBuffer& sink;
+    unsigned int fields;
+    OwnerNames owners;
+    std::string indentation;        ///< Spaces, grown to the deepest indentation seen.
+    bool started = false;           ///< Whether the outer '[' has been written.
+    bool first_element = true;      ///< Whether the open array has no element yet.
+    bool directory_open = false;    ///< Whether the last directory object awaits its '}'.
+    unsigned int open_arrays = 0;   ///< Nesting depth of "contents" arrays.
+};
+
+/**
+ * @class NdjsonEmitter
+ * @brief Writes one self-contained JSON record per line and entry.
+ *
+ * Every record carries the entry's full path, its depth and type and, when
+ * known, its size and modification time, so records can be processed
+ * independently while the walk still runs. The totals follow as a final
+ * "report" record.
+ */
+class NdjsonEmitter : public TreeEmitter {
+public:
+    /**
+     * @param fields MetadataField bits added to the size and mtime every record has.
+     */
+    NdjsonEmitter(OutputBuffer& output, unsigned int fields)
+        : sink(output), fields(fields | METADATA_SIZE | METADATA_MTIME) {}
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void begin_entries(unsigned int depth) override;
+    void end_entries() override;
+    void write_omitted(size_t omitted_count, unsigned int depth) override;
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return fields; }
+
+private:
+    void write_path(std::string_view name);
+
+    OutputBuffer& sink;
+    unsigned int fields;
+    OwnerNames owners;
+    std::string directory_path;        ///< Path of the listed directory, ending with '/'.
+    std::vector<size_t> path_lengths;  ///< directory_path sizes of the enclosing levels.
+    std::string last_directory;        ///< Name of the directory written last.
+};
+
+// Function Declarations
+void write_json_string(OutputBuffer& output, std::string_view text);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * @class OwnerNames
+ * @brief Caches the user names of owner ids.
+ */
+class OwnerNames {
+public:
+    /**
+     * @brief The login name of a user id, or the id itself when it has none.
+     */
+    std::string_view lookup(uint32_t owner);
+
+private:
+    std::unordered_map<uint32_t, std::string> names;
+};
+
+/**
+ * @brief The modification time in whole seconds since the epoch, rounded down.
+ */
+inline int64_t mtime_seconds(const EntryMetadata& metadata) {
+    int64_t seconds = metadata.mtime_ns / 1000000000;
+    return (metadata.mtime_ns % 1000000000 < 0) ? seconds - 1 : seconds;
+}
+
+// Function Declarations
+bool read_entry_metadata(
+    const OpenDirectory& directory,
+    std::string_view name,
+    unsigned int fields,
+    EntryMetadata& metadata,
+    bool follow_link = true
+);
+void read_listing_metadata(
+    const OpenDirectory& directory,
+    DirectoryListing& listing,
+    unsigned int fields,
+    bool batched = false
+);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+/**
+ * @class OutputBuffer
+ * @brief Large reusable buffer in front of a file descriptor.
+ *
+ * Lines are collected and handed to write(2) only when the buffer fills,
+ * on flush() and on destruction. When the descriptor is an interactive
+ * terminal every line is flushed right away so the tree still appears as
+ * it is walked.
+ */
+class OutputBuffer {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 128 * 1024;
+
+    explicit OutputBuffer(int fd = 1, size_t capacity = DEFAULT_CAPACITY);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    /**
+     * @brief Appends text, flushing first if it does not fit.
+     */
+    void write(std::string_view text);
+
+    /**
+     * @brief Appends text and a newline; flushes when interactive.
+     */
+    void write_line(std::string_view text);
+
+    /**
+     * @brief Hands everything buffered so far to the descriptor.
+     */
+    void flush();
+
+    /**
+     * @brief Whether the descriptor is a terminal.
+     */
+    bool is_interactive() const { return interactive; }
+
+private:
+    void write_all(const char* data, size_t size);
+
+    int fd;
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t used = 0;
+    bool interactive;
+    bool failed = false;
+};
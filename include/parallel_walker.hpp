@@ -0,0 +1,44 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Generates and prints the directory hierarchy using worker threads.
+ *
+ * Workers read subdirectories ahead of the printer while the calling thread
+ * acts as a sequencer that prints them in the same depth-first, sorted order
+ * as generate_directory_hierarchy().
+ *
+ * @param path The root directory path.
+ * @param options The settings of the current run.
+ * @param state The rendering state holding the level states and counters.
+ * @param thread_count The number of worker threads.
+ */
+void generate_directory_hierarchy_parallel(
+    std::string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int thread_count
+);
+
+/**
+ * @brief Generates and prints the hierarchies of several roots on one pool.
+ *
+ * Every directory root is queued before the first is printed, so the
+ * workers read all of them at once while the trees are still printed one
+ * after the other, in the order given. Roots that are files or invalid are
+ * handled by path_is_valid() when their turn comes.
+ *
+ * @param paths The root paths.
+ * @param options The settings of the current run.
+ * @param state The rendering state holding the emitter and counters.
+ * @param thread_count The number of worker threads.
+ */
+void generate_directory_hierarchies_parallel(
+    const std::vector<std::string>& paths,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int thread_count
+);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <string>
+
+/**
+ * @brief Generates and prints a directory hierarchy without empty subtrees.
+ *
+ * Like tree --prune: a directory is only printed when a file (or an
+ * omitted-entries line) is printed somewhere below it, so with --match
+ * only the directories leading to matches remain. The line of a directory
+ * is held back until its first printed descendant shows up; only the
+ * listings of the directories on the current path are kept in memory.
+ * Whether a later sibling is printed, which picks the connector of a line,
+ * is decided by a probe that stops at the first file it finds. What probes
+ * find is remembered per (device, inode), so a directory is read at most
+ * once by probes and once by the walk. Probes ignore the depth limit, so
+ * directories past it are only shown when they hold a file, and they
+ * bypass the snapshot cache.
+ *
+ * @param path The root directory path.
+ * @param options The settings of the current run.
+ * @param state The rendering state holding the emitter, counters and snapshot.
+ */
+void generate_directory_hierarchy_pruned(
+    std::string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state
+);
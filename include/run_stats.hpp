@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum StatsCounter
+ * @brief Operations counted by --stats.
+ */
+enum StatsCounter : unsigned int {
+    STATS_OPENDIR,       ///< Directories opened.
+    STATS_GETDENTS,      ///< getdents64 calls (the std::filesystem backend's reads are hidden).
+    STATS_STAT,          ///< Entries stat'ed, to resolve a type or read metadata.
+    STATS_WRITE,         ///< write(2) calls of the output.
+    STATS_BYTES_WRITTEN, ///< Bytes of output written.
+    STATS_COUNTER_COUNT
+};
+
+/**
+ * @enum StatsPhase
+ * @brief Where --stats attributes time.
+ */
+enum StatsPhase : unsigned int {
+    PHASE_READ,   ///< Enumerating directories.
+    PHASE_STAT,   ///< Resolving types and reading metadata.
+    PHASE_SORT,   ///< Sorting listings.
+    PHASE_RENDER, ///< Formatting output, not counting PHASE_OUTPUT.
+    PHASE_OUTPUT, ///< Writing output.
+    PHASE_COUNT
+};
+
+namespace run_stats_detail {
+
+/**
+ * @struct ThreadCounters
+ * @brief Counters of one thread; only that thread adds to them.
+ */
+struct ThreadCounters {
+    std::array<std::atomic<uint64_t>, STATS_COUNTER_COUNT> counters{};
+    std::array<std::atomic<uint64_t>, PHASE_COUNT> wall_ns{};
+    std::array<std::atomic<uint64_t>, PHASE_COUNT> cpu_ns{};
+};
+
+extern std::atomic<bool> enabled;
+ThreadCounters& thread_counters();
+uint64_t thread_cpu_ns();
+
+}
+
+/**
+ * @brief Whether --stats is collecting; a single relaxed load.
+ */
+inline bool stats_enabled() {
+    return run_stats_detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Adds to a counter of the calling thread, when --stats is on.
+ */
+inline void count_stat(StatsCounter counter, uint64_t amount = 1) {
+    if (!stats_enabled()) return;
+    run_stats_detail::thread_counters().counters[counter].fetch_add(
+        amount, std::memory_order_relaxed
+    );
+}
+
+/**
+ * @class PhaseTimer
+ * @brief Adds the wall and CPU time of a scope to a phase, when --stats is on.
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(StatsPhase phase) : phase(phase), active(stats_enabled()) {
+        if (!active) return;
+        start_wall = std::chrono::steady_clock::now();
+        start_cpu = run_stats_detail::thread_cpu_ns();
+    }
+
+    ~PhaseTimer() {
+        if (!active) return;
+        auto& counters = run_stats_detail::thread_counters();
+        auto wall = std::chrono::steady_clock::now() - start_wall;
+        counters.wall_ns[phase].fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count(),
+            std::memory_order_relaxed
+        );
+        counters.cpu_ns[phase].fetch_add(
+            run_stats_detail::thread_cpu_ns() - start_cpu, std::memory_order_relaxed
+        );
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    StatsPhase phase;
+    bool active;
+    std::chrono::steady_clock::time_point start_wall;
+    uint64_t start_cpu = 0;
+};
+
+/**
+ * @class RunStats
+ * @brief The --stats report of one run.
+ *
+ * Counters are kept per thread and only summed for the report, so the
+ * walk pays one relaxed load per instrumented call while --stats is off.
+ * Per-directory figures come from a StatsEmitter in front of the output.
+ */
+class RunStats {
+public:
+    /**
+     * @brief Starts collecting; counters of earlier runs are discarded.
+     */
+    void start();
+
+    /**
+     * @brief Notes how long the printer waited for a directory's entries.
+     */
+    void record_directory_wait(std::string_view path, uint64_t wait_ns);
+
+    /**
+     * @brief Notes the number of entries of a directory.
+     */
+    void record_directory_size(std::string_view path, size_t entry_count);
+
+    /**
+     * @brief Writes the report.
+     */
+    void report(std::ostream& stream) const;
+
+private:
+    static constexpr size_t SLOWEST_COUNT = 5;
+
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t start_cpu_ns = 0;
+    std::vector<std::pair<uint64_t, std::string>> slowest; ///< Longest waits first.
+    size_t peak_entries = 0;
+    std::string peak_directory;
+};
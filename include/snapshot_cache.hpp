@@ -0,0 +1,96 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @struct DirectoryStamp
+ * @brief Identity and change times of a directory.
+ *
+ * Adding, removing or renaming an entry updates the directory's mtime and
+ * ctime, so an unchanged stamp means an unchanged list of entries.
+ */
+struct DirectoryStamp {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+};
+
+/**
+ * @class SnapshotCache
+ * @brief On-disk snapshot of the raw directory listings of earlier runs.
+ *
+ * The snapshot file is mapped read-only. It holds one record per directory
+ * (its stamp, entry names, types and inodes), found through an index sorted
+ * by device and inode. Records hold what the backend read, before any
+ * ignore rule, sort or limit, so one snapshot serves every set of options.
+ * Directories whose stamp still matches are replayed from the mapping
+ * without being read; names point straight into it. All other directories
+ * are read as usual and recorded for save().
+ */
+class SnapshotCache {
+public:
+    /**
+     * @brief Maps the snapshot at a path; a missing or invalid file starts empty.
+     */
+    explicit SnapshotCache(std::string path);
+    ~SnapshotCache();
+
+    SnapshotCache(const SnapshotCache&) = delete;
+    SnapshotCache& operator=(const SnapshotCache&) = delete;
+
+    /**
+     * @brief Appends all files and directories of a directory to a listing.
+     *
+     * Entry names stay valid for the lifetime of the cache.
+     *
+     * @param directory The open directory to read.
+     * @param backend The backend the directory was opened with.
+     * @param listing The listing receiving the entries.
+     */
+    void read_entries(
+        const OpenDirectory& directory,
+        ReadBackend backend,
+        DirectoryListing& listing
+    );
+
+    /**
+     * @brief Replaces the snapshot file with the directories read by this run.
+     *
+     * Records of directories this run did not reach are kept, and a
+     * directory reached twice is stored once. Does nothing when every
+     * directory was replayed from the snapshot.
+     *
+     * @return false if the new snapshot could not be written.
+     */
+    bool save();
+
+private:
+    // A directory recorded by this run, in walk order.
+    struct VisitedRecord {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t offset; ///< In the mapping, or in fresh_records when fresh.
+        uint64_t size;
+        bool fresh;
+    };
+
+    const char* record_at(uint64_t offset) const;
+    const char* find_record(const DirectoryStamp& stamp) const;
+
+    std::string path;
+    const char* mapping = nullptr;
+    size_t mapping_size = 0;
+    uint64_t record_count = 0;
+    uint64_t index_offset = 0;
+    int64_t start_time_ns = 0;        ///< When this run started reading.
+    std::string fresh_records;        ///< Serialized records of directories read this run.
+    std::vector<VisitedRecord> visited;
+    size_t fresh_count = 0;
+};
+
+// Function Declarations
+bool snapshot_cache_available();
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "run_stats.hpp"
+#include "tree_emitter.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class StatsEmitter
+ * @brief Passes the tree through while measuring render time and directories.
+ *
+ * The time between a directory's line and the start of its entries is how
+ * long the printer waited for the directory to be opened and read.
+ */
+class StatsEmitter : public TreeEmitter {
+public:
+    StatsEmitter(std::unique_ptr<TreeEmitter> inner, RunStats& stats)
+        : inner(std::move(inner)), stats(stats) {}
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void begin_entries(unsigned int depth) override;
+    void end_entries() override;
+    void write_omitted(size_t omitted_count, unsigned int depth) override;
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return inner->metadata_fields(); }
+
+private:
+    std::unique_ptr<TreeEmitter> inner;
+    RunStats& stats;
+    std::string directory_path;        ///< Path of the listed directory, ending with '/'.
+    std::vector<size_t> path_lengths;  ///< directory_path sizes of the enclosing levels.
+    std::vector<size_t> entry_counts;  ///< Entries seen so far at each open level.
+    std::string last_directory;        ///< Name of the directory written last.
+    std::chrono::steady_clock::time_point last_directory_time;
+};
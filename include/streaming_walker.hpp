@@ -0,0 +1,24 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <string>
+
+/**
+ * @brief Generates and prints an unsorted directory hierarchy while reading it.
+ *
+ * Every entry is printed as soon as the one after it has been read, which
+ * is all it takes to choose between the branch and the last-entry marker.
+ * Memory grows with the depth of the tree, not with the size of its
+ * directories: each open level holds one read buffer and two names.
+ * Produces the same output as generate_directory_hierarchy() with sorting
+ * disabled.
+ *
+ * @param path The root directory path.
+ * @param options The settings of the current run; sort_entries is ignored.
+ * @param state The rendering state holding the level states and counters.
+ */
+void generate_directory_hierarchy_streaming(
+    std::string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state
+);
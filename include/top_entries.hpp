@@ -0,0 +1,81 @@
+#pragma once
+
+#include "tree_emitter.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class TopEntriesEmitter
+ * @brief Reports the largest or most recently modified files of the walk.
+ *
+ * Keeps a min-heap of the best @p limit files seen so far, so memory stays
+ * bounded by the report size however large the tree is; a file's path is
+ * only built when it enters the heap. With the summary, the wrapped
+ * emitter receives the root followed by the files, best first, named by
+ * their path below the root.
+ */
+class TopEntriesEmitter : public TreeEmitter {
+public:
+    /**
+     * @param inner The emitter writing the output format.
+     * @param limit The number of files reported.
+     * @param field METADATA_SIZE or METADATA_MTIME, the field files are ranked by.
+     */
+    TopEntriesEmitter(std::unique_ptr<TreeEmitter> inner, size_t limit, unsigned int field)
+        : inner(std::move(inner)), limit(limit), field(field) {}
+
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+    void begin_entries(unsigned int depth) override;
+    void end_entries() override;
+    void write_omitted(size_t, unsigned int) override {}
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return inner->metadata_fields() | field; }
+
+private:
+    /**
+     * @struct Candidate
+     * @brief A file in the running top list.
+     */
+    struct Candidate {
+        uint64_t key;          ///< Ranking value; larger is better.
+        uint64_t sequence;     ///< Walk order, which breaks ties.
+        std::string path;
+        EntryMetadata metadata;
+        bool is_link;
+        std::string target;    ///< Where a link points.
+    };
+
+    static bool better(const Candidate& left, const Candidate& right);
+    uint64_t ranking_key(const EntryMetadata& metadata) const;
+    void add_candidate(
+        std::string_view name,
+        const EntryMetadata* metadata,
+        bool is_link,
+        std::string_view target
+    );
+
+    std::unique_ptr<TreeEmitter> inner;
+    size_t limit;
+    unsigned int field;
+    std::vector<Candidate> heap;       ///< Min-heap: the worst candidate is at the front.
+    uint64_t sequence = 0;
+    std::string root;
+    bool root_is_directory = true;
+    std::string directory_path;        ///< Path of the listed directory below the root.
+    std::vector<size_t> path_lengths;  ///< directory_path sizes of the enclosing levels.
+    std::string last_directory;        ///< Name of the directory written last.
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "directory_tree.hpp"
+#include "output_buffer.hpp"
+#include <cstddef>
+#include <string>
+
+/**
+ * @struct TreeDiffCounts
+ * @brief What a diff found, for its summary line.
+ */
+struct TreeDiffCounts {
+    size_t added = 0;   ///< Entries only in the second tree; an added directory counts once.
+    size_t removed = 0; ///< Entries only in the first tree; a removed directory counts once.
+    size_t changed = 0; ///< Files whose compared fields differ, and links whose target does.
+};
+
+/**
+ * @brief Loads one side of a diff: walks a directory or reads a binary dump.
+ *
+ * A directory is walked sorted, with sizes and modification times, under
+ * the filters and limits of the options. A regular file is read as a dump
+ * written by --format bin, which must hold a single directory.
+ *
+ * @param path The directory or dump.
+ * @param options The settings of the walk.
+ * @param thread_count The number of threads reading directories.
+ * @param tree Receives the tree; should be empty.
+ * @return false, after printing an error, if the path cannot be used.
+ */
+bool load_diff_tree(
+    const std::string& path,
+    const HierarchyOptions& options,
+    unsigned int thread_count,
+    DirectoryTree& tree
+);
+
+/**
+ * @brief Prints what changed from one tree to another.
+ *
+ * Merge-walks the sorted entries of both roots in step. Entries found on
+ * one side only are written as "+ name" or "- name", without their
+ * contents, and an entry that changed kind as both; files whose size or
+ * (with METADATA_MTIME) modification time differ as "~ name", and links
+ * pointing elsewhere as "~ name -> new target". A directory found on both
+ * sides is written plainly, with the differences below it. Every subtree
+ * is digested first, so directories whose digests match are skipped in
+ * O(1) without comparing their entries.
+ *
+ * @param before The first tree.
+ * @param after The second tree, whose root name is written.
+ * @param compared_fields METADATA_SIZE and METADATA_MTIME bits compared for
+ * files, where both trees carry them.
+ * @param emitter The emitter receiving the differences.
+ * @return The counts for write_diff_summary().
+ */
+TreeDiffCounts emit_tree_diff(
+    const DirectoryTree& before,
+    const DirectoryTree& after,
+    unsigned int compared_fields,
+    TreeEmitter& emitter
+);
+
+// Function Declarations
+void write_diff_summary(const TreeDiffCounts& counts, OutputBuffer& output);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "directory_reader.hpp"
+#include "output_buffer.hpp"
+#include <memory>
+#include <string_view>
+
+struct HierarchyOptions;
+
+/**
+ * @enum OutputFormat
+ * @brief How the walked tree is written.
+ */
+enum class OutputFormat {
+    TEXT,  ///< Box-drawing tree, as printed by TreeRenderer.
+    JSON,  ///< One nested JSON document.
+    NDJSON, ///< One JSON record per entry.
+    BINARY  ///< Front-coded binary dump, see BinaryEmitter.
+};
+
+/**
+ * @enum Charset
+ * @brief Characters the text format draws the tree with.
+ */
+enum class Charset {
+    UTF8, ///< Box-drawing characters, as in "├───".
+    ASCII ///< Plain ASCII, as in "|---", for terminals without UTF-8.
+};
+
+/**
+ * @class TreeEmitter
+ * @brief Receives the walked tree in print order.
+ *
+ * The walkers describe the tree as a sequence of entries and the bounds of
+ * each directory's entries; emitters turn that into one output format.
+ * Depth 0 is the root, whose is_last flag is meaningless.
+ */
+class TreeEmitter {
+public:
+    virtual ~TreeEmitter() = default;
+
+    /**
+     * @brief Emits a file or a directory.
+     *
+     * @param name The entry name, or the root path at depth 0.
+     * @param depth The depth of the entry.
+     * @param is_directory Whether the entry is a directory.
+     * @param is_last Whether no sibling follows, not even an omitted-entries line.
+     * @param metadata The fields selected by metadata_fields(), or nullptr when none are.
+     */
+    virtual void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) = 0;
+
+    /**
+     * @brief Emits a symlink that is shown as a link rather than followed.
+     *
+     * Formats without a link type write it as the file "name -> target".
+     *
+     * @param target Where the link points, as stored in the link.
+     */
+    virtual void write_link(
+        std::string_view name,
+        std::string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    );
+
+    /**
+     * @brief Starts the entries of the directory just written at a depth.
+     *
+     * Directories below the depth limit are written without any entries.
+     */
+    virtual void begin_entries(unsigned int depth) = 0;
+
+    /**
+     * @brief Ends the entries started by the matching begin_entries().
+     */
+    virtual void end_entries() = 0;
+
+    /**
+     * @brief Emits the last entry of a directory cut off by --max-entries-per-dir.
+     */
+    virtual void write_omitted(size_t omitted_count, unsigned int depth) = 0;
+
+    /**
+     * @brief Emits the directory and file totals after the tree.
+     */
+    virtual void write_summary(unsigned int directory_count, unsigned int file_count) = 0;
+
+    /**
+     * @brief The MetadataField bits entries must come with; 0 for none.
+     */
+    virtual unsigned int metadata_fields() const { return 0; }
+};
+
+// Function Declarations
+std::unique_ptr<TreeEmitter> make_tree_emitter(
+    OutputFormat format,
+    OutputBuffer& output,
+    const HierarchyOptions& options
+);
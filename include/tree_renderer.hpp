@@ -0,0 +1,144 @@
+#pragma once
+
+#include "output_buffer.hpp"
+#include "metadata_reader.hpp"
+#include "tree_emitter.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @enum LevelState
+ * @brief Represents the iteration state of a directory level.
+ */
+enum LevelState {
+    NOT_ITERATING, ///< Indicates the last entry at the current level.
+    ITERATING,     ///< Indicates there are more entries to process at the current level.
+    NO_VALUE       ///< Indicates no specific state (used for the root level).
+};
+
+/**
+ * @struct TreeGlyphs
+ * @brief The characters a charset draws the tree with.
+ */
+template <Charset charset>
+struct TreeGlyphs;
+
+template <>
+struct TreeGlyphs<Charset::UTF8> {
+    static constexpr std::string_view branch = "├";
+    static constexpr std::string_view last = "└";
+    static constexpr std::string_view horizontal = "─";
+    static constexpr std::string_view vertical = "│";
+    static constexpr std::string_view ellipsis = "…";
+};
+
+template <>
+struct TreeGlyphs<Charset::ASCII> {
+    static constexpr std::string_view branch = "|";
+    static constexpr std::string_view last = "`";
+    static constexpr std::string_view horizontal = "-";
+    static constexpr std::string_view vertical = "|";
+    static constexpr std::string_view ellipsis = "...";
+};
+
+/**
+ * @class TreeRenderer
+ * @brief Writes tree lines with an incrementally maintained prefix.
+ *
+ * The prefix holds one "│   " or "    " segment per ancestor level. It
+ * grows by one segment when the entries of a subdirectory start and shrinks
+ * again when they end, so printing a line only copies the prefix, the
+ * connector and the name into the output buffer. Connectors and segments
+ * are built once from the spacing and charset, and are picked by level
+ * state; the line writer is specialized for the common y-spacings.
+ */
+class TreeRenderer : public TreeEmitter {
+public:
+    TreeRenderer(
+        OutputBuffer& output,
+        unsigned int x_spacing,
+        unsigned int y_spacing,
+        unsigned int columns = 0,
+        Charset charset = Charset::UTF8
+    );
+
+    /**
+     * @brief Writes the line (plus y-spacing lines) of an entry.
+     *
+     * Directory names are made sure to end with '/'. Selected columns go
+     * between the connector and the name, as in "├─── [  4096]  name".
+     */
+    void write_entry(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override;
+
+    /**
+     * @brief Appends the prefix segment of a level whose entries follow.
+     *
+     * @param depth The depth of the directory whose entries get printed.
+     */
+    void begin_entries(unsigned int depth) override;
+
+    /**
+     * @brief Removes the segment added by the matching begin_entries().
+     */
+    void end_entries() override;
+
+    /**
+     * @brief Writes the "… (N more)" line.
+     */
+    void write_omitted(size_t omitted_count, unsigned int depth) override;
+
+    /**
+     * @brief Writes the "N directories, M files" line after a blank line.
+     */
+    void write_summary(unsigned int directory_count, unsigned int file_count) override;
+    unsigned int metadata_fields() const override { return columns; }
+
+private:
+    void set_level_state(unsigned int depth, LevelState state);
+    void write_line(
+        std::string_view name,
+        unsigned int depth,
+        bool is_directory,
+        const EntryMetadata* metadata
+    );
+    void write_root_line(std::string_view name, bool is_directory, const EntryMetadata* metadata);
+    template <unsigned int padding_lines>
+    void write_connected_line(
+        std::string_view name,
+        bool is_directory,
+        LevelState state,
+        const EntryMetadata* metadata
+    );
+    template <Charset charset>
+    void build_fragments(unsigned int x_spacing);
+    void format_columns(const EntryMetadata* metadata);
+
+    // write_connected_line() instantiation matching y_spacing
+    using LineWriter = void (TreeRenderer::*)(
+        std::string_view, bool, LevelState, const EntryMetadata*
+    );
+
+    OutputBuffer& sink;
+    unsigned int y_spacing;
+    unsigned int columns;                ///< MetadataField bits shown before names.
+    std::string column_text;             ///< Columns of the line being written.
+    OwnerNames owners;
+    LineWriter line_writer;
+    std::string connectors[2];           ///< Per LevelState: "└───" and "├───".
+    std::string segments[2];             ///< Per LevelState: "    " and "│   ".
+    std::string_view vertical;           ///< The y-padding line after the prefix.
+    std::string_view ellipsis;           ///< Starts the omitted-entries line.
+    std::vector<LevelState> level_states; ///< Iteration state per depth level.
+    std::string prefix;                  ///< Segments of all ancestor levels.
+    std::vector<size_t> segment_lengths; ///< Byte length of each prefix segment.
+};
+
+// Function Declarations
+std::string generate_character_string(unsigned int n, std::string s);
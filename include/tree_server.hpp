@@ -0,0 +1,56 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <string>
+
+/**
+ * @struct TreeRequest
+ * @brief A subtree asked of a --serve daemon, and how to print it.
+ *
+ * What is listed (filters, sorting, caps) is set when the daemon starts;
+ * a request only picks the directory and the rendering.
+ */
+struct TreeRequest {
+    std::string path;                  ///< Absolute, normalized path of the directory.
+    std::string name;                  ///< Shown on the header line, as given by the user.
+    OutputFormat format = OutputFormat::TEXT;
+    unsigned int columns = 0;          ///< MetadataField bits shown as columns.
+    unsigned int max_depth = 0;        ///< Deepest level listed below the directory; 0 = no limit.
+    unsigned int x_spacing = 3;
+    unsigned int y_spacing = 1;
+    Charset charset = Charset::UTF8;
+};
+
+/**
+ * @brief Keeps a directory tree in memory and answers requests for its subtrees.
+ *
+ * The tree is loaded once and kept current with inotify, like --watch;
+ * every request is rendered from memory after applying the events already
+ * queued. Requests arrive over a Unix socket and are answered one at a
+ * time. Runs until interrupted, then removes the socket.
+ *
+ * @param socket_path Where the socket is created; a stale socket is replaced.
+ * @param path The root directory served.
+ * @param options The settings of the walk, which every request shares.
+ * @return The process exit status.
+ */
+int serve_directory_hierarchy(
+    const std::string& socket_path,
+    const std::string& path,
+    const HierarchyOptions& options
+);
+
+/**
+ * @brief Asks a --serve daemon for a subtree and prints the answer.
+ *
+ * @param socket_path The daemon's socket.
+ * @param request The subtree and how to print it.
+ * @param output The sink the tree is printed to.
+ * @return The process exit status: 1, after printing an error, if the
+ * daemon cannot be reached or refuses the request.
+ */
+int request_directory_hierarchy(
+    const std::string& socket_path,
+    const TreeRequest& request,
+    OutputBuffer& output
+);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <string>
+
+/**
+ * @brief Generates and prints the directory hierarchy with io_uring opens.
+ *
+ * Subdirectories are opened ahead of the printer by batches of
+ * IORING_OP_OPENAT requests; every completed open lands in a ready queue
+ * whose directories are read (and, with columns, stat'ed in batches) on
+ * the calling thread, which then prints them in the same order as
+ * generate_directory_hierarchy(). Always reads with the getdents backend.
+ *
+ * @param path The root directory path.
+ * @param options The settings of the current run.
+ * @param state The rendering state holding the emitter and counters.
+ * @return false, with nothing printed, if io_uring is not available.
+ */
+bool generate_directory_hierarchy_uring(
+    std::string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state
+);
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "hierarchy.hpp"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+
+/**
+ * @struct WatchedDirectory
+ * @brief A visited directory and the listings of its visited subdirectories.
+ */
+struct WatchedDirectory {
+    WatchedDirectory() = default;
+    ~WatchedDirectory();
+
+    WatchedDirectory* parent = nullptr;
+    std::string path;
+    std::string name; ///< Shown in the header; the root path at the root.
+    unsigned int depth = 0;
+    std::shared_ptr<const GitignoreScope> gitignore;
+    DirectoryListing listing;
+    /// One per directory entry of the listing, in order; null below the depth limit.
+    std::vector<std::unique_ptr<WatchedDirectory>> subdirectories;
+    int watch = -1;
+};
+
+/**
+ * @class TreeWatcher
+ * @brief Owns an in-memory tree and the inotify descriptor keeping it current.
+ *
+ * Keeps the listing of every visited directory in memory and watches each
+ * of them with inotify. Events only mark directories as changed; only
+ * those are read again, by apply_changes(), and everything else is
+ * rendered from memory. The caller owns the event loop, so the tree can
+ * be reprinted (--watch) or served to clients (--serve).
+ */
+class TreeWatcher {
+public:
+    explicit TreeWatcher(const HierarchyOptions& options) : options(options) {}
+    ~TreeWatcher();
+
+    TreeWatcher(const TreeWatcher&) = delete;
+    TreeWatcher& operator=(const TreeWatcher&) = delete;
+
+    /**
+     * @brief Starts watching and loads the whole tree below a directory.
+     *
+     * @return false, after printing an error, if the directory cannot be watched.
+     */
+    bool start(const std::string& path);
+
+    /**
+     * @brief The inotify descriptor, to poll for events.
+     */
+    int descriptor() const { return inotify_fd; }
+
+    /**
+     * @brief Reads the events that are ready and marks the directories they name.
+     *
+     * @return false if the root directory itself went away.
+     */
+    bool read_events();
+
+    /**
+     * @brief Whether read_events() marked directories that are not read again yet.
+     */
+    bool has_changes() const { return !changed.empty(); }
+
+    /**
+     * @brief Reads every marked directory again.
+     */
+    void apply_changes();
+
+    const WatchedDirectory& root_directory() const { return *root; }
+
+    /**
+     * @brief Finds a loaded directory by its path below the root.
+     *
+     * @param relative_path Components separated by '/'; empty for the root.
+     * @return The directory, or nullptr if it is not in the tree.
+     */
+    const WatchedDirectory* find(std::string_view relative_path) const;
+
+    /**
+     * @brief Emits the entries of a loaded directory and their subtrees.
+     *
+     * @param directory The directory, whose own line was already written.
+     * @param render_options The depth limit of the output.
+     * @param state The rendering state holding the emitter and counters.
+     * @param depth The depth the directory is shown at.
+     */
+    void render_entries(
+        const WatchedDirectory& directory,
+        const HierarchyOptions& render_options,
+        HierarchyState& state,
+        unsigned int depth
+    ) const;
+
+private:
+    void watch(WatchedDirectory& directory);
+    void refresh(WatchedDirectory& directory, bool reload_subtree);
+    void refresh_listing(
+        WatchedDirectory& directory,
+        bool reload_subtree,
+        std::vector<std::pair<WatchedDirectory*, bool>>& pending
+    );
+    void release(WatchedDirectory& directory);
+
+    const HierarchyOptions& options;
+    int inotify_fd = -1;
+    std::unique_ptr<WatchedDirectory> root;
+    std::unordered_map<int, WatchedDirectory*> watched; ///< Directory of each watch descriptor.
+    /// Watch descriptors of changed directories, mapped to whether their
+    /// whole subtree must be read again.
+    std::unordered_map<int, bool> changed;
+};
+
+#endif
+
+/**
+ * @brief Prints the directory hierarchy and reprints it whenever it changes.
+ *
+ * Events are collected until the tree has been quiet for a short while, so
+ * a burst of writes causes a single refresh. Runs until interrupted.
+ *
+ * @param path The root directory path.
+ * @param options The settings of the current run.
+ * @param format The format each reprint is written in.
+ * @param output The sink the tree is printed to.
+ * @return The process exit status once watching is no longer possible.
+ */
+int watch_directory_hierarchy(
+    const std::string& path,
+    const HierarchyOptions& options,
+    OutputFormat format,
+    OutputBuffer& output
+);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class WorkStealingPool
+ * @brief Fixed-size thread pool where every worker owns a task deque.
+ *
+ * A worker pushes and pops tasks at the back of its own deque (LIFO, so it
+ * keeps descending into the subtree it just read) and, once that runs dry,
+ * steals from the front of the other deques (FIFO, so thieves take the
+ * oldest and usually largest pending subtrees).
+ */
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(unsigned int thread_count);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * @brief Queues a task.
+     *
+     * Called from a worker, the task lands on that worker's own deque;
+     * called from any other thread, the deques are filled round-robin.
+     */
+    void submit(Task task);
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(unsigned int index);
+    bool pop_local(unsigned int index, Task& task);
+    bool steal(unsigned int thief, Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending_count{0};
+    std::atomic<unsigned int> next_queue{0};
+    std::mutex idle_mutex;
+    std::condition_variable idle_condition;
+    std::atomic<bool> stopping{false}; ///< Set by the destructor; queued tasks are dropped.
+};
@@ -0,0 +1,366 @@
+#include "../include/binary_format.hpp"
+#include "../include/metadata_reader.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::string_view;
+
+namespace {
+
+constexpr char MAGIC[4] = {'L', 'S', 'T', 'B'};
+constexpr char TRAILER_MAGIC[8] = {'L', 'S', 'T', 'B', 'I', 'D', 'X', '1'};
+constexpr uint8_t VERSION = 2;
+constexpr uint8_t FIRST_VERSION = 1; ///< The oldest version still read.
+
+// Tag byte: the kind in the low two bits, flags above
+enum RecordKind : uint8_t {
+    KIND_FILE = 0,
+    KIND_DIRECTORY = 1,
+    KIND_OMITTED = 2,
+    KIND_SUMMARY = 3
+};
+constexpr uint8_t KIND_MASK = 0x3;
+constexpr uint8_t FLAG_LAST = 0x4;     ///< No sibling follows.
+constexpr uint8_t FLAG_OPENED = 0x8;   ///< The directory's entries follow.
+constexpr uint8_t FLAG_METADATA = 0x10; ///< Size and mtime follow the name.
+constexpr uint8_t FLAG_LINK = 0x20;     ///< A file record is a link; its target follows the name.
+
+void append_varint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void append_u64(string& out, uint64_t value) {
+    for (int i = 0; i < 8; i++)
+        out += static_cast<char>(value >> (8 * i));
+}
+
+uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/**
+ * @class RecordReader
+ * @brief Bounds-checked cursor over the bytes of a dump.
+ */
+class RecordReader {
+public:
+    explicit RecordReader(string_view bytes) : bytes(bytes) {}
+
+    bool read_byte(uint8_t& value) {
+        if (position >= bytes.size()) return false;
+        value = static_cast<uint8_t>(bytes[position++]);
+        return true;
+    }
+
+    bool read_varint(uint64_t& value) {
+        value = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!read_byte(byte)) return false;
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool read_bytes(uint64_t length, string_view& value) {
+        if (length > bytes.size() - position) return false;
+        value = bytes.substr(position, length);
+        position += length;
+        return true;
+    }
+
+private:
+    string_view bytes;
+    size_t position = 0;
+};
+
+}
+
+BinaryEmitter::BinaryEmitter(OutputBuffer& output) : sink(output) {
+    record.assign(MAGIC, sizeof(MAGIC));
+    record += static_cast<char>(VERSION);
+    sink.write(record);
+    offset = record.size();
+}
+
+/**
+ * @brief Writes the encoded record with its tag in front.
+ */
+void BinaryEmitter::write_record(uint8_t tag) {
+    sink.write(string_view(reinterpret_cast<const char*>(&tag), 1));
+    sink.write(record);
+    offset += 1 + record.size();
+}
+
+/**
+ * @brief Writes the held-back directory record.
+ *
+ * @param opened Whether the directory's entries follow.
+ */
+void BinaryEmitter::flush_directory(bool opened) {
+    if (!directory_pending) return;
+    directory_pending = false;
+    if (opened)
+        index.emplace_back(offset, 0);
+    record.swap(pending_body);
+    write_record(pending_tag | (opened ? FLAG_OPENED : 0));
+    record.swap(pending_body);
+}
+
+/**
+ * @brief Starts a record with the depth and the name, front-coded against the previous sibling.
+ */
+void BinaryEmitter::encode_name(string_view name, unsigned int depth) {
+    flush_directory(false);
+    if (previous_names.size() <= depth)
+        previous_names.resize(depth + 1);
+    string& previous = previous_names[depth];
+    size_t shared = 0;
+    size_t limit = std::min(previous.size(), name.size());
+    while (shared < limit && previous[shared] == name[shared])
+        shared++;
+    record.clear();
+    append_varint(record, depth);
+    append_varint(record, shared);
+    append_varint(record, name.size() - shared);
+    record.append(name.substr(shared));
+    previous.assign(name);
+}
+
+/**
+ * @brief Appends the size and mtime of an entry, if it has them.
+ */
+static uint8_t append_metadata(string& record, const EntryMetadata* metadata) {
+    if (!metadata) return 0;
+    append_varint(record, metadata->size);
+    append_varint(record, zigzag(mtime_seconds(*metadata)));
+    return FLAG_METADATA;
+}
+
+void BinaryEmitter::write_link(
+    string_view name,
+    string_view target,
+    unsigned int depth,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    encode_name(name, depth);
+    uint8_t tag = KIND_FILE | FLAG_LINK | (is_last ? FLAG_LAST : 0);
+    append_varint(record, target.size());
+    record.append(target);
+    tag |= append_metadata(record, metadata);
+    write_record(tag);
+}
+
+void BinaryEmitter::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    encode_name(name, depth);
+    uint8_t tag = (is_directory ? KIND_DIRECTORY : KIND_FILE) | (is_last ? FLAG_LAST : 0);
+    tag |= append_metadata(record, metadata);
+    if (is_directory) {
+        directory_pending = true;
+        pending_tag = tag;
+        pending_body.swap(record);
+    } else {
+        write_record(tag);
+    }
+}
+
+void BinaryEmitter::begin_entries(unsigned int depth) {
+    flush_directory(true);
+    open_directories.push_back(index.size() - 1);
+    // The first entry of a directory is coded against nothing
+    if (previous_names.size() <= depth + 1)
+        previous_names.resize(depth + 2);
+    previous_names[depth + 1].clear();
+}
+
+void BinaryEmitter::end_entries() {
+    flush_directory(false);
+    index[open_directories.back()].second = offset;
+    open_directories.pop_back();
+}
+
+void BinaryEmitter::write_omitted(size_t omitted_count, unsigned int depth) {
+    flush_directory(false);
+    record.clear();
+    append_varint(record, depth);
+    append_varint(record, omitted_count);
+    write_record(KIND_OMITTED | FLAG_LAST);
+}
+
+void BinaryEmitter::write_summary(unsigned int directory_count, unsigned int file_count) {
+    flush_directory(false);
+    record.clear();
+    append_varint(record, directory_count);
+    append_varint(record, file_count);
+    write_record(KIND_SUMMARY);
+    uint64_t index_offset = offset;
+    record.clear();
+    append_u64(record, index.size());
+    for (const auto& [start, end] : index) {
+        append_u64(record, start);
+        append_u64(record, end);
+    }
+    append_u64(record, index_offset);
+    record.append(TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+    sink.write(record);
+    offset += record.size();
+}
+
+/**
+ * @brief Replays the records of a dump into an emitter.
+ *
+ * @return false if the dump is malformed or truncated.
+ */
+static bool replay_records(string_view bytes, TreeEmitter& emitter) {
+    if (bytes.size() < sizeof(MAGIC) + 1 || std::memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) != 0
+        || static_cast<uint8_t>(bytes[sizeof(MAGIC)]) < FIRST_VERSION
+        || static_cast<uint8_t>(bytes[sizeof(MAGIC)]) > VERSION)
+        return false;
+    RecordReader reader(bytes.substr(sizeof(MAGIC) + 1));
+    std::vector<uint64_t> open_depths;
+    std::vector<string> previous_names;
+    EntryMetadata metadata;
+    while (true) {
+        uint8_t tag;
+        if (!reader.read_byte(tag)) return false;
+        uint8_t kind = tag & KIND_MASK;
+        if (kind == KIND_SUMMARY) {
+            uint64_t directory_count, file_count;
+            if (!reader.read_varint(directory_count) || !reader.read_varint(file_count))
+                return false;
+            for (; !open_depths.empty(); open_depths.pop_back())
+                emitter.end_entries();
+            emitter.write_summary(directory_count, file_count);
+            return true;
+        }
+        uint64_t depth;
+        if (!reader.read_varint(depth)) return false;
+        // Entries either continue the innermost open directory or end it
+        while (!open_depths.empty() && open_depths.back() >= depth) {
+            emitter.end_entries();
+            open_depths.pop_back();
+        }
+        uint64_t expected_depth = open_depths.empty() ? 0 : open_depths.back() + 1;
+        if (depth != expected_depth) return false;
+        if (kind == KIND_OMITTED) {
+            uint64_t count;
+            if (!reader.read_varint(count)) return false;
+            emitter.write_omitted(count, depth);
+            continue;
+        }
+        uint64_t shared, suffix_length;
+        string_view suffix;
+        if (!reader.read_varint(shared) || !reader.read_varint(suffix_length)
+            || !reader.read_bytes(suffix_length, suffix))
+            return false;
+        if (previous_names.size() <= depth)
+            previous_names.resize(depth + 1);
+        string& name = previous_names[depth];
+        if (shared > name.size()) return false;
+        name.resize(shared);
+        name.append(suffix);
+        bool is_link = kind == KIND_FILE && (tag & FLAG_LINK);
+        uint64_t target_length;
+        string_view target;
+        if (is_link && (!reader.read_varint(target_length) || !reader.read_bytes(target_length, target)))
+            return false;
+        bool has_metadata = tag & FLAG_METADATA;
+        if (has_metadata) {
+            uint64_t size, seconds;
+            if (!reader.read_varint(size) || !reader.read_varint(seconds)) return false;
+            metadata.size = size;
+            metadata.mtime_ns = unzigzag(seconds) * 1000000000;
+            metadata.fields = METADATA_SIZE | METADATA_MTIME;
+        }
+        bool is_directory = kind == KIND_DIRECTORY;
+        if (is_link) {
+            emitter.write_link(name, target, depth, tag & FLAG_LAST,
+                has_metadata ? &metadata : nullptr
+            );
+        } else {
+            emitter.write_entry(name, depth, is_directory, tag & FLAG_LAST,
+                has_metadata ? &metadata : nullptr
+            );
+        }
+        if (is_directory && (tag & FLAG_OPENED)) {
+            emitter.begin_entries(depth);
+            open_depths.push_back(depth);
+            if (previous_names.size() <= depth + 1)
+                previous_names.resize(depth + 2);
+            previous_names[depth + 1].clear();
+        }
+    }
+}
+
+/**
+ * @brief Renders a dump written by --format bin through an emitter.
+ *
+ * The file is mapped rather than read where possible.
+ *
+ * @param path The dump file.
+ * @param emitter The emitter receiving the tree.
+ * @return false, after printing an error, if the file cannot be read or is malformed.
+ */
+bool render_binary_tree(const string& path, TreeEmitter& emitter) {
+    bool valid = false;
+#ifdef __linux__
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        cerr << "Error: cannot open " << path << ": " << std::strerror(errno) << endl;
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        cerr << "Error: " << path << " is not an lstree dump." << endl;
+        return false;
+    }
+    void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "Error: cannot map " << path << ": " << std::strerror(errno) << endl;
+        return false;
+    }
+    valid = replay_records(string_view(static_cast<const char*>(mapped), status.st_size), emitter);
+    munmap(mapped, status.st_size);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        cerr << "Error: cannot open " << path << endl;
+        return false;
+    }
+    string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    valid = replay_records(contents, emitter);
+#endif
+    if (!valid)
+        cerr << "Error: " << path << " is not a complete lstree dump." << endl;
+    return valid;
+}
@@ -0,0 +1,182 @@
+#include "../include/byte_search.hpp"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+using std::string_view;
+
+namespace {
+
+using SearchFunction = size_t (*)(const char*, size_t, const char*, size_t, size_t);
+
+/**
+ * @brief Whether the needle's inner bytes follow a candidate position.
+ *
+ * The candidate already matched the needle's first and last byte.
+ */
+inline bool inner_bytes_match(const char* candidate, const char* needle, size_t length) {
+    return length <= 2 || std::memcmp(candidate + 1, needle + 1, length - 2) == 0;
+}
+
+/**
+ * @brief Finds the needle by jumping between occurrences of its first byte.
+ */
+size_t find_scalar(
+    const char* haystack,
+    size_t size,
+    const char* needle,
+    size_t length,
+    size_t from
+) {
+    while (from + length <= size) {
+        const void* first = std::memchr(haystack + from, needle[0], size - length + 1 - from);
+        if (!first) break;
+        size_t position = static_cast<const char*>(first) - haystack;
+        if (haystack[position + length - 1] == needle[length - 1]
+            && inner_bytes_match(haystack + position, needle, length))
+            return position;
+        from = position + 1;
+    }
+    return string_view::npos;
+}
+
+#if defined(__x86_64__)
+
+/**
+ * @brief Compares 32 positions at once against the needle's first and last byte.
+ *
+ * Only positions whose both ends match are compared in full. The loop only
+ * loads bytes inside the haystack; the last few positions go through
+ * find_scalar().
+ */
+__attribute__((target("avx2")))
+size_t find_avx2(
+    const char* haystack,
+    size_t size,
+    const char* needle,
+    size_t length,
+    size_t from
+) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[length - 1]);
+    for (; from + length - 1 + 32 <= size; from += 32) {
+        __m256i block_first = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(haystack + from));
+        __m256i block_last = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(haystack + from + length - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last))));
+        while (mask) {
+            size_t position = from + __builtin_ctz(mask);
+            if (inner_bytes_match(haystack + position, needle, length)) return position;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(haystack, size, needle, length, from);
+}
+
+#elif defined(__aarch64__)
+
+/**
+ * @brief The NEON version of find_avx2(), 16 positions per step.
+ *
+ * Narrowing the comparison result leaves 4 bits per position in a 64-bit
+ * mask, which stands in for the movemask NEON lacks.
+ */
+size_t find_neon(
+    const char* haystack,
+    size_t size,
+    const char* needle,
+    size_t length,
+    size_t from
+) {
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(needle[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(needle[length - 1]));
+    for (; from + length - 1 + 16 <= size; from += 16) {
+        uint8x16_t block_first = vld1q_u8(reinterpret_cast<const uint8_t*>(haystack + from));
+        uint8x16_t block_last = vld1q_u8(
+            reinterpret_cast<const uint8_t*>(haystack + from + length - 1));
+        uint8x16_t equal = vandq_u8(vceqq_u8(block_first, first), vceqq_u8(block_last, last));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+        mask &= 0x8888888888888888ull;
+        while (mask) {
+            size_t position = from + (__builtin_ctzll(mask) >> 2);
+            if (inner_bytes_match(haystack + position, needle, length)) return position;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(haystack, size, needle, length, from);
+}
+
+#endif
+
+/**
+ * @brief Picks the widest kernel the CPU supports.
+ */
+SearchKernel detect_kernel() {
+#if defined(__x86_64__)
+    // Runs during static initialization, before the CPU model may be set up
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SearchKernel::AVX2;
+#elif defined(__aarch64__)
+    return SearchKernel::NEON;
+#endif
+    return SearchKernel::SCALAR;
+}
+
+SearchFunction kernel_function(SearchKernel kernel) {
+    switch (kernel) {
+#if defined(__x86_64__)
+        case SearchKernel::AVX2:
+            return find_avx2;
+#elif defined(__aarch64__)
+        case SearchKernel::NEON:
+            return find_neon;
+#endif
+        default:
+            return find_scalar;
+    }
+}
+
+const SearchKernel selected_kernel = detect_kernel();
+const SearchFunction selected_function = kernel_function(selected_kernel);
+
+}
+
+/**
+ * @brief Finds the first occurrence of a byte string.
+ *
+ * Runs on the kernel returned by search_kernel(); all kernels give the
+ * same result.
+ *
+ * @param haystack The bytes to search.
+ * @param needle The bytes to find; an empty needle is found at @p from.
+ * @param from The first position to consider.
+ * @return The position of the occurrence, or string_view::npos.
+ */
+size_t find_bytes(string_view haystack, string_view needle, size_t from) {
+    if (needle.empty()) return from <= haystack.size() ? from : string_view::npos;
+    return selected_function(haystack.data(), haystack.size(), needle.data(), needle.size(), from);
+}
+
+SearchKernel search_kernel() {
+    return selected_kernel;
+}
+
+const char* search_kernel_name(SearchKernel kernel) {
+    switch (kernel) {
+        case SearchKernel::AVX2:
+            return "avx2";
+        case SearchKernel::NEON:
+            return "neon";
+        case SearchKernel::SCALAR:
+            break;
+    }
+    return "scalar";
+}
@@ -0,0 +1,640 @@
+#include "../include/directory_reader.hpp"
+#include "../include/entry_sort.hpp"
+#include "../include/run_stats.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <system_error>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Copies a name into the arena, followed by a NUL byte.
+ *
+ * Blocks start small and double up to BLOCK_SIZE, so listings of tiny
+ * directories stay tiny. The trailing NUL lets the getdents backend pass
+ * stored names straight to openat().
+ */
+string_view NameArena::store(string_view name) {
+    size_t needed = name.size() + 1;
+    if (needed > block_remaining) {
+        block_capacity = std::max(
+            needed, std::min(BLOCK_SIZE, std::max<size_t>(block_capacity * 2, 1024))
+        );
+        blocks.push_back(std::make_unique_for_overwrite<char[]>(block_capacity));
+        block_cursor = blocks.back().get();
+        block_remaining = block_capacity;
+    }
+    char* stored = block_cursor;
+    std::memcpy(stored, name.data(), name.size());
+    stored[name.size()] = '\0';
+    block_cursor += needed;
+    block_remaining -= needed;
+    return string_view(stored, name.size());
+}
+
+void NameArena::adopt(unique_ptr<char[]> block) {
+    // Moving the owner does not move the bytes, so the append cursor stays valid
+    blocks.push_back(std::move(block));
+}
+
+OpenDirectory::~OpenDirectory() {
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#endif
+}
+
+OpenDirectory::OpenDirectory(OpenDirectory&& other) noexcept
+    : path(std::move(other.path)), fd(other.fd) {
+    other.fd = -1;
+}
+
+OpenDirectory& OpenDirectory::operator=(OpenDirectory&& other) noexcept {
+    if (this != &other) {
+        OpenDirectory closing(std::move(*this));
+        path = std::move(other.path);
+        fd = other.fd;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+/**
+ * @brief Maps a directory_iterator entry to the type it is listed with.
+ *
+ * @return false if the entry is neither a file, a directory nor a symlink.
+ */
+static bool classify_entry(const fs::directory_entry& entry, EntryType& type) {
+    std::error_code error;
+    if (entry.is_symlink(error)) {
+        type = EntryType::SYMLINK;
+    } else if (entry.is_directory(error)) {
+        type = EntryType::DIRECTORY;
+    } else if (entry.is_regular_file(error)) {
+        type = EntryType::REGULAR_FILE;
+    } else {
+        return false; // Neither a file nor a directory
+    }
+    return true;
+}
+
+/**
+ * @brief Enumerates a directory with std::filesystem::directory_iterator.
+ *
+ * The member type checks reuse the d_type cached by the iterator. Symlinks
+ * are left unresolved, so following them costs a stat only for entries
+ * that are actually listed. The iterator does not expose inode numbers, so
+ * they are left at 0.
+ */
+static bool read_std_filesystem_entries(
+    const OpenDirectory& directory,
+    const EntryFilter& keep,
+    DirectoryListing& listing,
+    size_t max_entries
+) {
+    count_stat(STATS_OPENDIR);
+    for (const auto& entry : fs::directory_iterator(directory.path)) {
+        if (max_entries && listing.entries.size() >= max_entries) return false;
+        string name = entry.path().filename().string();
+        if (keep && !keep(name)) continue;
+        EntryType type;
+        if (!classify_entry(entry, type)) continue;
+        listing.entries.push_back(make_listed_entry(listing.names.store(name), type));
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+// Layout of the records returned by getdents64(2).
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Size of a single getdents64 read.
+static constexpr size_t GETDENTS_BUFFER_SIZE = 256 * 1024;
+
+/**
+ * @brief Throws the filesystem_error the std::filesystem backend would throw.
+ */
+[[noreturn]] static void throw_errno(const char* what, string_view name) {
+    throw fs::filesystem_error(
+        what, fs::path(name), std::error_code(errno, std::system_category())
+    );
+}
+
+/**
+ * @brief Maps the d_type of a getdents64 record to the type it is listed with.
+ *
+ * @return false if the entry is neither a file, a directory nor a symlink.
+ */
+static bool classify_record(const linux_dirent64& record, EntryType& type) {
+    switch (record.d_type) {
+        case DT_DIR:
+            type = EntryType::DIRECTORY;
+            return true;
+        case DT_REG:
+            type = EntryType::REGULAR_FILE;
+            return true;
+        case DT_LNK:
+            type = EntryType::SYMLINK;
+            return true;
+        case DT_UNKNOWN:
+            type = EntryType::UNRESOLVED;
+            return true;
+        default:
+            return false; // Neither a file nor a directory
+    }
+}
+
+// The read buffer of each thread, kept between directories until a
+// listing adopts it.
+static thread_local unique_ptr<char[]> spare_getdents_buffer;
+
+/**
+ * @struct GetdentsBuffer
+ * @brief Borrows the thread's read buffer, allocating one only when a listing kept the last.
+ *
+ * The buffer is not zeroed: getdents64() overwrites every byte it reports.
+ */
+struct GetdentsBuffer {
+    GetdentsBuffer() : block(std::move(spare_getdents_buffer)) {}
+    ~GetdentsBuffer() {
+        if (block) spare_getdents_buffer = std::move(block);
+    }
+
+    char* get() {
+        if (!block) block = std::make_unique_for_overwrite<char[]>(GETDENTS_BUFFER_SIZE);
+        return block.get();
+    }
+
+    unique_ptr<char[]> block;
+};
+
+/**
+ * @brief Enumerates a directory descriptor with raw getdents64 reads.
+ *
+ * Names of reads that fill at least half the buffer stay in the buffer,
+ * which the listing then adopts; names of short reads are copied into the
+ * arena so small directories do not pin a whole buffer each. Entry types
+ * come from d_type; symlinks are not followed and DT_UNKNOWN entries are
+ * left unresolved.
+ */
+static bool read_getdents_entries(
+    const OpenDirectory& directory,
+    const EntryFilter& keep,
+    DirectoryListing& listing,
+    size_t max_entries
+) {
+    GetdentsBuffer buffer;
+    while (true) {
+        // Stopping between reads leaves the descriptor where the next read begins
+        if (max_entries && listing.entries.size() >= max_entries) return false;
+        char* data = buffer.get();
+        long bytes_read = syscall(SYS_getdents64, directory.fd, data, GETDENTS_BUFFER_SIZE);
+        count_stat(STATS_GETDENTS);
+        if (bytes_read < 0) throw_errno("cannot read directory", directory.path);
+        if (bytes_read == 0) return true;
+        bool adopt_buffer = static_cast<size_t>(bytes_read) >= GETDENTS_BUFFER_SIZE / 2;
+        for (long offset = 0; offset < bytes_read;) {
+            auto* record = reinterpret_cast<linux_dirent64*>(data + offset);
+            offset += record->d_reclen;
+            string_view name(record->d_name);
+            if (name == "." || name == "..") continue;
+            if (keep && !keep(name)) continue;
+            EntryType type;
+            if (!classify_record(*record, type)) continue;
+            if (!adopt_buffer) name = listing.names.store(name);
+            listing.entries.push_back(make_listed_entry(name, type, record->d_ino));
+        }
+        // The next read, if any, allocates a fresh buffer
+        if (adopt_buffer) listing.names.adopt(std::move(buffer.block));
+    }
+}
+
+#endif
+
+/**
+ * @brief Determines the type of an unresolved entry, and of a symlink's target
+ * when following links.
+ *
+ * A symlink that is not followed stays a link without costing a stat. A
+ * followed symlink takes the type of its target; one that dangles, or
+ * points at something that is neither a file nor a directory, stays a link.
+ *
+ * @param directory The open directory containing the entry.
+ * @param entry The entry; its type is updated in place.
+ * @param follow_links Whether symlinks are listed as what they point to.
+ * @return false if the entry is neither a file, a directory nor a symlink
+ * and should not be listed.
+ */
+bool resolve_entry_type(const OpenDirectory& directory, ListedEntry& entry, bool follow_links) {
+    if (entry.type == EntryType::SYMLINK && !follow_links) return true;
+    if (entry.type != EntryType::UNRESOLVED && entry.type != EntryType::SYMLINK) return true;
+    bool is_link = entry.type == EntryType::SYMLINK;
+    bool is_directory = false;
+    bool is_file = false;
+    count_stat(STATS_STAT);
+#ifdef __linux__
+    if (directory.fd >= 0) {
+        // Listing names are NUL-terminated, see NameArena::store()
+        struct stat status;
+        if (!is_link) {
+            if (fstatat(directory.fd, entry.name.data(), &status, AT_SYMLINK_NOFOLLOW) != 0)
+                return false;
+            is_link = S_ISLNK(status.st_mode);
+            if (is_link && follow_links) count_stat(STATS_STAT);
+        }
+        if (!is_link || follow_links) {
+            if (!is_link || fstatat(directory.fd, entry.name.data(), &status, 0) == 0) {
+                is_directory = S_ISDIR(status.st_mode);
+                is_file = S_ISREG(status.st_mode);
+            }
+        }
+    } else
+#endif
+    {
+        std::error_code error;
+        fs::path path = fs::path(directory.path) / entry.name;
+        if (!is_link)
+            is_link = fs::is_symlink(fs::symlink_status(path, error));
+        if (!is_link || follow_links) {
+            fs::file_status status = fs::status(path, error);
+            is_directory = fs::is_directory(status);
+            is_file = fs::is_regular_file(status);
+        }
+    }
+    if (is_directory || is_file) {
+        entry.type = is_directory ? EntryType::DIRECTORY : EntryType::REGULAR_FILE;
+        return true;
+    }
+    entry.type = EntryType::SYMLINK;
+    return is_link;
+}
+
+/**
+ * @brief Reads where a symlink in an open directory points.
+ *
+ * @param directory The open directory containing the link.
+ * @param name The link name; must be NUL-terminated for the getdents backend.
+ * @param target Receives the target, as stored in the link.
+ * @return false if the link cannot be read.
+ */
+bool read_link_target(const OpenDirectory& directory, string_view name, string& target) {
+    target.clear();
+#ifdef __linux__
+    if (directory.fd >= 0) {
+        char buffer[4096];
+        ssize_t length = readlinkat(directory.fd, name.data(), buffer, sizeof(buffer));
+        if (length < 0) return false;
+        target.assign(buffer, static_cast<size_t>(length));
+        return true;
+    }
+#endif
+    std::error_code error;
+    fs::path link = fs::read_symlink(fs::path(directory.path) / name, error);
+    if (error) return false;
+    target = link.string();
+    return true;
+}
+
+/**
+ * @brief Reads the targets of the links of a listing into its names arena.
+ *
+ * Leaves link_targets empty when the listing holds no link; unreadable
+ * links get an empty target.
+ */
+void read_link_targets(const OpenDirectory& directory, DirectoryListing& listing) {
+    listing.link_targets.clear();
+    string target;
+    for (size_t i = 0; i < listing.entries.size(); i++) {
+        if (!listing.entries[i].is_link()) continue;
+        if (listing.link_targets.empty())
+            listing.link_targets.resize(listing.entries.size());
+        if (read_link_target(directory, listing.entries[i].name, target))
+            listing.link_targets[i] = listing.names.store(target);
+    }
+}
+
+/**
+ * @brief The device and inode of an open directory.
+ *
+ * @return false if the directory cannot be stat'ed, or the platform has no
+ * inode numbers.
+ */
+bool directory_identity(const OpenDirectory& directory, uint64_t& device, uint64_t& inode) {
+#ifdef __linux__
+    count_stat(STATS_STAT);
+    struct stat status;
+    int result = directory.fd >= 0
+        ? fstat(directory.fd, &status)
+        : stat(directory.path.c_str(), &status);
+    if (result != 0) return false;
+    device = status.st_dev;
+    inode = status.st_ino;
+    return true;
+#else
+    (void)directory;
+    device = inode = 0;
+    return false;
+#endif
+}
+
+/**
+ * @brief Reads a regular file located directly in an open directory.
+ *
+ * Uses openat() relative to the directory descriptor when there is one.
+ *
+ * @param directory The open directory.
+ * @param name The file name; must be NUL-terminated for the getdents backend.
+ * @param contents Receives the file contents.
+ * @return false if the file does not exist or cannot be read.
+ */
+bool read_directory_file(
+    const OpenDirectory& directory,
+    string_view name,
+    string& contents
+) {
+    contents.clear();
+#ifdef __linux__
+    if (directory.fd >= 0) {
+        int fd = openat(directory.fd, string(name).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        char chunk[4096];
+        ssize_t bytes_read;
+        while ((bytes_read = read(fd, chunk, sizeof(chunk))) > 0)
+            contents.append(chunk, static_cast<size_t>(bytes_read));
+        close(fd);
+        return bytes_read == 0;
+    }
+#endif
+    string path = directory.path;
+    if (!path.empty() && path.back() != '/')
+        path += "/";
+    path += name;
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/**
+ * @brief Whether the getdents backend is compiled in for this platform.
+ */
+bool getdents_backend_available() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Opens the directory a walk starts from.
+ *
+ * @param path The root directory path.
+ * @param backend The backend that will read the directory.
+ * @return The open root directory.
+ */
+OpenDirectory open_root_directory(const string& path, ReadBackend backend) {
+#ifdef __linux__
+    if (backend == ReadBackend::GETDENTS) {
+        int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        count_stat(STATS_OPENDIR);
+        if (fd < 0) throw_errno("cannot open directory", path);
+        return OpenDirectory(path, fd);
+    }
+#endif
+    return OpenDirectory(path, -1);
+}
+
+/**
+ * @brief Opens a subdirectory of an open directory.
+ *
+ * @param parent The open parent directory.
+ * @param name The subdirectory name, as stored in the parent's listing.
+ * @param backend The backend that will read the subdirectory.
+ * @return The open subdirectory.
+ */
+OpenDirectory open_subdirectory(
+    const OpenDirectory& parent,
+    string_view name,
+    ReadBackend backend
+) {
+#ifdef __linux__
+    if (backend == ReadBackend::GETDENTS) {
+        int fd;
+        if (parent.fd >= 0) {
+            // Listing names are NUL-terminated, see NameArena::store()
+            fd = openat(parent.fd, name.data(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        } else {
+            // The parent was detached, see detach_directory()
+            string path = parent.path;
+            if (path.back() != '/') path += "/";
+            path += name;
+            fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        count_stat(STATS_OPENDIR);
+        if (fd < 0) throw_errno("cannot open directory", name);
+        return OpenDirectory("", fd);
+    }
+#endif
+    string path = parent.path;
+    if (!path.empty() && path.back() != '/')
+        path += "/";
+    path += name;
+    return OpenDirectory(path, -1);
+}
+
+/**
+ * @brief How many directory descriptors a walk keeps open along its path.
+ *
+ * Deeper paths release the descriptors of their upper directories, see
+ * release_directory(). A quarter of the descriptor limit leaves the rest
+ * to everything else a run opens.
+ */
+size_t open_directory_limit() {
+#ifdef __linux__
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        return std::max<size_t>(4, limit.rlim_cur / 4);
+#endif
+    return std::numeric_limits<size_t>::max();
+}
+
+/**
+ * @brief Closes the descriptor of a directory that a subdirectory can reopen.
+ *
+ * The descriptor is only closed when the subdirectory's ".." is the
+ * directory itself, which it is not for a subdirectory entered through a
+ * symlink. The path of the directory is kept for error messages.
+ *
+ * @param directory The directory to release.
+ * @param subdirectory An open subdirectory of it, kept open until
+ * reacquire_directory().
+ * @return false, leaving the descriptor open, if it cannot be reopened.
+ */
+bool release_directory(OpenDirectory& directory, const OpenDirectory& subdirectory) {
+#ifdef __linux__
+    if (directory.fd < 0 || subdirectory.fd < 0) return false;
+    struct stat self;
+    struct stat parent;
+    count_stat(STATS_STAT);
+    count_stat(STATS_STAT);
+    if (fstat(directory.fd, &self) != 0 || fstatat(subdirectory.fd, "..", &parent, 0) != 0)
+        return false;
+    if (self.st_dev != parent.st_dev || self.st_ino != parent.st_ino) return false;
+    close(directory.fd);
+    directory.fd = -1;
+    return true;
+#else
+    (void)directory;
+    (void)subdirectory;
+    return false;
+#endif
+}
+
+/**
+ * @brief Reopens a released directory through the ".." of its subdirectory.
+ *
+ * @param directory The directory release_directory() closed.
+ * @param subdirectory The subdirectory it was released for.
+ */
+void reacquire_directory(OpenDirectory& directory, const OpenDirectory& subdirectory) {
+#ifdef __linux__
+    directory.fd = openat(subdirectory.fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    count_stat(STATS_OPENDIR);
+    if (directory.fd < 0)
+        throw_errno("cannot reopen directory", directory.path.empty() ? ".." : directory.path);
+#else
+    (void)directory;
+    (void)subdirectory;
+#endif
+}
+
+/**
+ * @brief Trades the descriptor of a directory for its full path.
+ *
+ * For walkers that keep a directory around until its subdirectories are
+ * opened, once they hold their share of open_directory_limit(); the
+ * subdirectories are then opened by path. Directories whose subdirectory
+ * paths could exceed PATH_MAX stay open.
+ *
+ * @param directory The directory to detach.
+ * @return false, leaving the descriptor open, if its path is unknown.
+ */
+bool detach_directory(OpenDirectory& directory) {
+#ifdef __linux__
+    if (directory.fd < 0) return false;
+    char buffer[PATH_MAX];
+    string link = "/proc/self/fd/" + std::to_string(directory.fd);
+    ssize_t length = readlink(link.c_str(), buffer, sizeof(buffer));
+    if (length <= 0 || length + 1 + NAME_MAX >= PATH_MAX || buffer[0] != '/') return false;
+    directory.path.assign(buffer, length);
+    close(directory.fd);
+    directory.fd = -1;
+    return true;
+#else
+    (void)directory;
+    return false;
+#endif
+}
+
+/**
+ * @brief Appends the files and directories of a directory to a listing.
+ *
+ * @param directory The open directory to read.
+ * @param backend The backend the directory was opened with.
+ * @param keep Decides by name which entries are kept; called before any
+ * per-entry stat. An empty filter keeps every entry.
+ * @param listing The listing receiving the entries and their names.
+ * @param max_entries Stop once at least this many entries were listed; 0 = read all.
+ * A DirectoryCursor opened afterwards continues where the getdents backend
+ * stopped, but starts over with the std::filesystem backend.
+ * @return false if the read stopped early.
+ */
+bool read_directory_entries(
+    const OpenDirectory& directory,
+    ReadBackend backend,
+    const EntryFilter& keep,
+    DirectoryListing& listing,
+    size_t max_entries
+) {
+#ifdef __linux__
+    if (backend == ReadBackend::GETDENTS)
+        return read_getdents_entries(directory, keep, listing, max_entries);
+#endif
+    return read_std_filesystem_entries(directory, keep, listing, max_entries);
+}
+
+DirectoryCursor::DirectoryCursor(const OpenDirectory& directory, ReadBackend backend)
+    : directory(directory), backend(backend) {
+#ifdef __linux__
+    if (backend == ReadBackend::GETDENTS) {
+        buffer = std::make_unique_for_overwrite<char[]>(BUFFER_SIZE);
+        return;
+    }
+#endif
+    count_stat(STATS_OPENDIR);
+    iterator = fs::directory_iterator(directory.path);
+}
+
+bool DirectoryCursor::next(ListedEntry& entry) {
+    PhaseTimer timer(PHASE_READ);
+#ifdef __linux__
+    if (backend == ReadBackend::GETDENTS) {
+        while (true) {
+            if (buffer_offset == buffer_size) {
+                buffer_size = syscall(
+                    SYS_getdents64, directory.fd, buffer.get(), BUFFER_SIZE
+                );
+                count_stat(STATS_GETDENTS);
+                buffer_offset = 0;
+                if (buffer_size < 0) {
+                    buffer_size = 0;
+                    throw_errno("cannot read directory", directory.path);
+                }
+                if (buffer_size == 0) return false;
+            }
+            auto* record = reinterpret_cast<linux_dirent64*>(buffer.get() + buffer_offset);
+            buffer_offset += record->d_reclen;
+            string_view name(record->d_name);
+            if (name == "." || name == "..") continue;
+            EntryType type;
+            if (!classify_record(*record, type)) continue;
+            entry = make_listed_entry(name, type, record->d_ino);
+            return true;
+        }
+    }
+#endif
+    for (; iterator != fs::directory_iterator(); ++iterator) {
+        EntryType type;
+        if (!classify_entry(*iterator, type)) continue;
+        current_name = iterator->path().filename().string();
+        ++iterator;
+        entry = make_listed_entry(current_name, type);
+        return true;
+    }
+    return false;
+}
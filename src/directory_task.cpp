@@ -0,0 +1,123 @@
+#include "../include/directory_task.hpp"
+#include <utility>
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+/**
+ * @brief Opens a task's directory, reads its listing and creates its subdirectory tasks.
+ *
+ * Roots not yet opened are opened here, subdirectories through the
+ * engine's open step. Any error is stored in the task, to be rethrown when
+ * it is printed. The new tasks are left to the caller to schedule.
+ *
+ * @param task The task to read.
+ * @param options The settings of the current run.
+ * @param open_directory Opens the directory of a task that has a parent.
+ * @param budget Directories the subdirectory tasks may keep open.
+ */
+void read_directory_task(
+    DirectoryTask& task,
+    const HierarchyOptions& options,
+    const SubdirectoryOpener& open_directory,
+    const shared_ptr<DescriptorBudget>& budget
+) {
+    try {
+        OpenDirectory directory;
+        if (task.parent_directory) {
+            directory = open_directory(task);
+            task.parent_directory.reset();
+        } else if (task.directory) {
+            directory = std::move(*task.directory);
+            task.directory.reset();
+        } else {
+            // A root; opened here so that many roots open in parallel
+            directory = open_root_directory(task.name, options.backend);
+            if (options.use_gitignore)
+                task.gitignore = GitignoreScope::open_root(directory);
+        }
+        if (task.parent_gitignore) {
+            task.gitignore = GitignoreScope::open_subdirectory(
+                task.parent_gitignore, directory, task.name
+            );
+            task.parent_gitignore.reset();
+        }
+        task.listing = read_directory_listing(directory, options, task.gitignore.get());
+        bool lists_subdirectories = lists_entries_at(options, task.depth + 1);
+        shared_ptr<const OpenDirectory> parent;
+        for (const auto& entry : task.listing.entries) {
+            if (!entry.is_directory() || !lists_subdirectories) continue;
+            if (!parent) {
+                // Kept open for the subdirectories while the budget allows
+                if (directory.fd >= 0 && budget->try_hold()) {
+                    parent = shared_ptr<const OpenDirectory>(
+                        new OpenDirectory(std::move(directory)),
+                        [budget](const OpenDirectory* held) {
+                            delete held;
+                            budget->release();
+                        }
+                    );
+                } else {
+                    detach_directory(directory);
+                    parent = make_shared<const OpenDirectory>(std::move(directory));
+                }
+            }
+            auto subdirectory = make_shared<DirectoryTask>(
+                string(entry.name), parent, task.depth + 1
+            );
+            subdirectory->parent_gitignore = task.gitignore;
+            task.subdirectories.push_back(std::move(subdirectory));
+        }
+        task.gitignore.reset();
+    } catch (...) {
+        task.error = std::current_exception();
+        task.subdirectories.clear();
+    }
+}
+
+/**
+ * @brief Prints the entries of a task's subtree, waiting for reads as needed.
+ *
+ * The task's own line has already been written, before any waiting,
+ * exactly like the serial walker. Each subtree is released as soon as it
+ * has been printed.
+ *
+ * @param root The task whose entries are printed.
+ * @param depth The depth of the root.
+ * @param options The settings of the current run.
+ * @param state The rendering state holding the emitter and counters.
+ * @param wait_for Blocks until a task is done; the engine's own step.
+ * @param released Called after each printed subtree was released.
+ */
+void render_directory_task(
+    const shared_ptr<DirectoryTask>& root,
+    unsigned int depth,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    const DirectoryTaskWaiter& wait_for,
+    const SubdirectoryLeaver& released
+) {
+    // The tasks being printed, each with its index among its parent's subdirectories
+    vector<std::pair<DirectoryTask*, size_t>> path = {{root.get(), 0}};
+    wait_for(*root);
+    if (root->error) std::rethrow_exception(root->error);
+    process_directory_entries(root->listing, state, depth + 1,
+        [&](const ListedEntry&, size_t index) -> const DirectoryListing* {
+            // Below the depth limit no task exists; only the name is shown
+            if (!lists_entries_at(options, depth + path.size())) return nullptr;
+            DirectoryTask& task = *path.back().first->subdirectories[index];
+            wait_for(task);
+            if (task.error) std::rethrow_exception(task.error);
+            path.emplace_back(&task, index);
+            return &task.listing;
+        },
+        [&] {
+            size_t index = path.back().second;
+            path.pop_back();
+            path.back().first->subdirectories[index].reset();
+            if (released) released();
+        }
+    );
+}
@@ -0,0 +1,148 @@
+#include "../include/directory_tree.hpp"
+#include "../include/parallel_walker.hpp"
+
+using std::string;
+using std::string_view;
+
+void DirectoryTreeBuilder::add_node(const DirectoryTree::Node& node, const EntryMetadata* metadata) {
+    tree.node_array.push_back(node);
+    tree.node_array.back().subtree_end = tree.node_array.size();
+    if (fields)
+        tree.entry_metadata.push_back(metadata ? *metadata : EntryMetadata());
+}
+
+void DirectoryTreeBuilder::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    DirectoryTree::Node node;
+    node.name_offset = tree.names.size();
+    node.name_length = name.size();
+    node.depth = depth;
+    node.kind = is_directory ? DirectoryTree::NodeKind::DIRECTORY : DirectoryTree::NodeKind::FILE;
+    node.is_last = is_last;
+    tree.names.append(name);
+    add_node(node, metadata);
+}
+
+void DirectoryTreeBuilder::write_link(
+    string_view name,
+    string_view target,
+    unsigned int depth,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    DirectoryTree::Node node;
+    node.name_offset = tree.names.size();
+    node.name_length = name.size();
+    node.target_length = target.size();
+    node.depth = depth;
+    node.kind = DirectoryTree::NodeKind::LINK;
+    node.is_last = is_last;
+    tree.names.append(name);
+    tree.names.append(target);
+    add_node(node, metadata);
+}
+
+void DirectoryTreeBuilder::begin_entries(unsigned int) {
+    // The entries belong to the directory just written
+    size_t directory = tree.node_array.size() - 1;
+    tree.node_array[directory].opened = true;
+    open_directories.push_back(directory);
+}
+
+void DirectoryTreeBuilder::end_entries() {
+    tree.node_array[open_directories.back()].subtree_end = tree.node_array.size();
+    open_directories.pop_back();
+}
+
+void DirectoryTreeBuilder::write_omitted(size_t omitted_count, unsigned int depth) {
+    DirectoryTree::Node node;
+    node.name_offset = omitted_count;
+    node.depth = depth;
+    node.kind = DirectoryTree::NodeKind::OMITTED;
+    node.is_last = true;
+    add_node(node, nullptr);
+}
+
+void DirectoryTreeBuilder::write_summary(unsigned int directory_count, unsigned int file_count) {
+    tree.directory_count = directory_count;
+    tree.file_count = file_count;
+}
+
+/**
+ * @brief Prints a tree through an emitter, summary included.
+ *
+ * @param tree The tree.
+ * @param emitter The emitter of the output format.
+ * @param max_depth The deepest level whose entries are printed; 0 = all.
+ * Directories at that level are printed as if they were never opened.
+ */
+void emit_directory_tree(const DirectoryTree& tree, TreeEmitter& emitter, unsigned int max_depth) {
+    const auto& nodes = tree.nodes();
+    // Ends of the directories whose entries are being emitted
+    std::vector<uint64_t> open_ends;
+    for (size_t i = 0; i < nodes.size();) {
+        while (!open_ends.empty() && open_ends.back() == i) {
+            emitter.end_entries();
+            open_ends.pop_back();
+        }
+        const DirectoryTree::Node& node = nodes[i];
+        if (node.kind == DirectoryTree::NodeKind::OMITTED) {
+            emitter.write_omitted(node.name_offset, node.depth);
+            i++;
+            continue;
+        }
+        if (node.kind == DirectoryTree::NodeKind::LINK) {
+            emitter.write_link(tree.name(node), tree.target(node), node.depth, node.is_last,
+                tree.metadata(i));
+            i++;
+            continue;
+        }
+        bool is_directory = node.kind == DirectoryTree::NodeKind::DIRECTORY;
+        emitter.write_entry(tree.name(node), node.depth, is_directory, node.is_last, tree.metadata(i));
+        if (node.opened && (max_depth == 0 || node.depth < max_depth)) {
+            emitter.begin_entries(node.depth);
+            open_ends.push_back(node.subtree_end);
+            i++;
+        } else {
+            // Skip what is below the depth limit in one step
+            i = node.subtree_end;
+        }
+    }
+    while (!open_ends.empty()) {
+        emitter.end_entries();
+        open_ends.pop_back();
+    }
+    emitter.write_summary(tree.directory_count, tree.file_count);
+}
+
+/**
+ * @brief Walks a path into a DirectoryTree, without printing anything.
+ *
+ * @param path The root path; a file gives a one-node tree.
+ * @param options The settings of the walk; its metadata_fields are kept.
+ * @param thread_count The number of threads reading directories.
+ * @return The tree; empty if the path does not exist.
+ */
+DirectoryTree build_directory_tree(
+    string path,
+    const HierarchyOptions& options,
+    unsigned int thread_count
+) {
+    DirectoryTree tree;
+    DirectoryTreeBuilder builder(tree, options.metadata_fields);
+    HierarchyState state(builder);
+    if (std::filesystem::is_directory(path))
+        state.directory_count = 1;
+    if (thread_count > 1) {
+        generate_directory_hierarchy_parallel(path, options, state, thread_count);
+    } else {
+        generate_directory_hierarchy(path, options, state);
+    }
+    print_summary(state);
+    return tree;
+}
@@ -0,0 +1,56 @@
+#include "../include/disk_usage.hpp"
+
+using std::vector;
+
+/**
+ * @brief Replaces the size of every directory with the total of its subtree.
+ *
+ * One pass over the nodes in print order: files add to the directory
+ * being walked, and each finished directory adds its totals to its
+ * parent. Also sets the directories' file counts.
+ *
+ * @param tree A tree carrying METADATA_SIZE, and METADATA_IDENTITY for dedup.
+ */
+void add_subtree_totals(DirectoryTree& tree) {
+    const auto& nodes = tree.nodes();
+    if (!tree.metadata(0)) return;
+    InodeSet counted_files;
+    vector<size_t> open_directories;
+    auto finish_directory = [&] {
+        const EntryMetadata& totals = *tree.metadata(open_directories.back());
+        open_directories.pop_back();
+        if (open_directories.empty()) return;
+        EntryMetadata& parent = *tree.metadata(open_directories.back());
+        parent.size += totals.size;
+        parent.file_count += totals.file_count;
+    };
+    for (size_t i = 0; i < nodes.size(); i++) {
+        while (!open_directories.empty() && nodes[open_directories.back()].subtree_end <= i)
+            finish_directory();
+        EntryMetadata& metadata = *tree.metadata(i);
+        if (nodes[i].kind == DirectoryTree::NodeKind::DIRECTORY) {
+            // The directory's own size is replaced by its total
+            metadata.size = 0;
+            metadata.file_count = 0;
+            metadata.fields |= METADATA_SIZE | METADATA_FILES;
+            open_directories.push_back(i);
+        } else if ((nodes[i].kind == DirectoryTree::NodeKind::FILE
+            || nodes[i].kind == DirectoryTree::NodeKind::LINK) && !open_directories.empty()) {
+            EntryMetadata& parent = *tree.metadata(open_directories.back());
+            parent.file_count++;
+            bool first_link = !(metadata.fields & METADATA_IDENTITY)
+                || counted_files.insert(metadata.device, metadata.inode);
+            if (first_link && (metadata.fields & METADATA_SIZE))
+                parent.size += metadata.size;
+        }
+    }
+    while (!open_directories.empty())
+        finish_directory();
+}
+
+void DiskUsageEmitter::write_summary(unsigned int directory_count, unsigned int file_count) {
+    builder.write_summary(directory_count, file_count);
+    add_subtree_totals(tree);
+    emit_directory_tree(tree, *inner, max_depth);
+    tree = DirectoryTree();
+}
@@ -0,0 +1,90 @@
+#include "../include/entry_sort.hpp"
+#include "../include/run_stats.hpp"
+#include <algorithm>
+
+using std::string_view;
+using std::vector;
+
+// Directories at least this large are radix sorted on their sort keys.
+static constexpr size_t RADIX_SORT_THRESHOLD = 1024;
+
+/**
+ * @brief Orders two entries by name, looking at the sort keys first.
+ *
+ * Most comparisons are decided by one integer compare; only names sharing
+ * their first 8 bytes touch the name bytes at all.
+ */
+bool entry_name_less(const ListedEntry& a, const ListedEntry& b) {
+    if (a.sort_key != b.sort_key) return a.sort_key < b.sort_key;
+    return a.name < b.name;
+}
+
+/**
+ * @brief Sorts entries by the remainder of their names.
+ *
+ * Used on runs sharing a sort key, whose first 8 bytes are all equal.
+ */
+static void sort_by_name_suffix(vector<ListedEntry>::iterator first, vector<ListedEntry>::iterator last) {
+    std::sort(first, last, [](const ListedEntry& a, const ListedEntry& b) {
+        string_view suffix_a = a.name.size() > 8 ? a.name.substr(8) : string_view();
+        string_view suffix_b = b.name.size() > 8 ? b.name.substr(8) : string_view();
+        return suffix_a < suffix_b;
+    });
+}
+
+/**
+ * @brief Least-significant-digit radix sort on the 64-bit sort keys.
+ *
+ * Eight counting passes of one byte each; a pass is skipped when every
+ * entry has the same byte there, which is common for names sharing a
+ * prefix. Runs with equal keys are then finished by comparing the rest of
+ * their names.
+ */
+static void radix_sort_entries(vector<ListedEntry>& entries) {
+    vector<ListedEntry> scratch(entries.size());
+    for (unsigned int pass = 0; pass < 8; pass++) {
+        unsigned int shift = pass * 8;
+        size_t counts[256] = {};
+        for (const auto& entry : entries)
+            counts[(entry.sort_key >> shift) & 0xff]++;
+        // Skip passes where all entries share the byte
+        if (counts[(entries.front().sort_key >> shift) & 0xff] == entries.size())
+            continue;
+        size_t offsets[256];
+        size_t total = 0;
+        for (unsigned int bucket = 0; bucket < 256; bucket++) {
+            offsets[bucket] = total;
+            total += counts[bucket];
+        }
+        for (const auto& entry : entries)
+            scratch[offsets[(entry.sort_key >> shift) & 0xff]++] = entry;
+        entries.swap(scratch);
+    }
+    // Finish runs of equal keys
+    auto run_start = entries.begin();
+    while (run_start != entries.end()) {
+        auto run_end = run_start + 1;
+        while (run_end != entries.end() && run_end->sort_key == run_start->sort_key)
+            ++run_end;
+        if (run_end - run_start > 1)
+            sort_by_name_suffix(run_start, run_end);
+        run_start = run_end;
+    }
+}
+
+/**
+ * @brief Sorts entries by name without allocating per comparison.
+ *
+ * Small directories use a comparison sort on the precomputed keys; large
+ * ones use a radix sort on the same keys.
+ *
+ * @param entries The entries to sort in place.
+ */
+void sort_entries_by_name(vector<ListedEntry>& entries) {
+    PhaseTimer timer(PHASE_SORT);
+    if (entries.size() >= RADIX_SORT_THRESHOLD) {
+        radix_sort_entries(entries);
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), entry_name_less);
+}
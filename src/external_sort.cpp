@@ -0,0 +1,221 @@
+#include "../include/external_sort.hpp"
+#include "../include/entry_sort.hpp"
+#include "../include/run_stats.hpp"
+#include <algorithm>
+#include <cstring>
+
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+
+namespace {
+
+// A spilled entry is its type, inode and name length, then the name bytes.
+constexpr size_t RECORD_HEADER_SIZE = 1 + sizeof(uint64_t) + sizeof(uint16_t);
+
+// Bytes of spilled records collected before each write.
+constexpr size_t SPILL_BUFFER_SIZE = 1024 * 1024;
+
+size_t run_bytes(const DirectoryListing& listing) {
+    size_t bytes = listing.entries.size() * sizeof(ListedEntry);
+    for (const auto& entry : listing.entries)
+        bytes += entry.name.size() + 1;
+    return bytes;
+}
+
+}
+
+ExternalSort::ExternalSort(const HierarchyOptions& options, const GitignoreScope* gitignore)
+    : options(options), gitignore(gitignore) {}
+
+ExternalSort::~ExternalSort() {
+    if (sorter.joinable()) sorter.join();
+    if (spill_file) std::fclose(spill_file);
+}
+
+void ExternalSort::read_runs(const OpenDirectory& directory, DirectoryListing& first_chunk) {
+    auto run = std::make_unique<Run>();
+    run->listing = std::move(first_chunk);
+    // The std::filesystem backend cannot resume a read, so the cursor
+    // starts over and skips what the first chunk already holds
+    size_t skipped = (options.backend == ReadBackend::GETDENTS) ? 0 : run->listing.entries.size();
+    sorter = std::thread([this, &directory, run = std::move(run)]() mutable {
+        sort_run(directory, std::move(run));
+    });
+    DirectoryCursor cursor(directory, options.backend);
+    ListedEntry entry;
+    bool more = true;
+    while (more) {
+        auto chunk = std::make_unique<Run>();
+        chunk->listing.entries.reserve(options.sort_chunk_entries);
+        while (chunk->listing.entries.size() < options.sort_chunk_entries) {
+            if (!cursor.next(entry)) {
+                more = false;
+                break;
+            }
+            if (skipped > 0) {
+                skipped--;
+                continue;
+            }
+            entry.name = chunk->listing.names.store(entry.name);
+            chunk->listing.entries.push_back(entry);
+        }
+        // At most one chunk is sorted while the next one is read
+        sorter.join();
+        if (!chunk->listing.entries.empty())
+            sorter = std::thread([this, &directory, chunk = std::move(chunk)]() mutable {
+                sort_run(directory, std::move(chunk));
+            });
+    }
+    if (sorter.joinable()) sorter.join();
+    start_merge();
+}
+
+/**
+ * @brief Filters and sorts a chunk, then keeps it in memory or spills it.
+ *
+ * Runs on the sorter thread; read_runs() joins it before touching the runs.
+ */
+void ExternalSort::sort_run(const OpenDirectory& directory, unique_ptr<Run> run) {
+    filter_directory_entries(run->listing, directory, options, gitignore);
+    if (run->listing.entries.empty()) return;
+    sort_entries_by_name(run->listing.entries);
+    total_count += run->listing.entries.size();
+    size_t bytes = run_bytes(run->listing);
+    // A run that cannot be written stays in memory, over the budget
+    if (memory_used + bytes > options.sort_memory && spill(*run)) {
+        run->listing = DirectoryListing();
+    } else {
+        memory_used += bytes;
+    }
+    runs.push_back(std::move(run));
+}
+
+/**
+ * @brief Appends the records of a sorted run to the temporary file.
+ *
+ * @return false if the file cannot be created or written.
+ */
+bool ExternalSort::spill(Run& run) {
+    if (!spill_file) spill_file = std::tmpfile();
+    if (!spill_file) return false;
+    string records;
+    records.reserve(SPILL_BUFFER_SIZE + RECORD_HEADER_SIZE + 65535);
+    uint64_t written = 0;
+    auto write_records = [&] {
+        bool ok = std::fwrite(records.data(), 1, records.size(), spill_file) == records.size();
+        written += records.size();
+        records.clear();
+        return ok;
+    };
+    bool ok = std::fseek(spill_file, static_cast<long>(spill_size), SEEK_SET) == 0;
+    for (const auto& entry : run.listing.entries) {
+        if (!ok) break;
+        uint16_t length = static_cast<uint16_t>(entry.name.size());
+        records += static_cast<char>(entry.type);
+        records.append(reinterpret_cast<const char*>(&entry.inode), sizeof(entry.inode));
+        records.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        records.append(entry.name);
+        if (records.size() >= SPILL_BUFFER_SIZE) ok = write_records();
+    }
+    if (ok && !records.empty()) ok = write_records();
+    if (!ok) return false;
+    run.file_offset = spill_size;
+    run.file_end = spill_size + written;
+    run.spilled = true;
+    spill_size = run.file_end;
+    return true;
+}
+
+/**
+ * @brief Moves a cursor to the next entry of its run.
+ *
+ * @return false once the run is exhausted.
+ */
+bool ExternalSort::advance(RunCursor& cursor) {
+    Run& run = *runs[cursor.run];
+    if (!run.spilled) {
+        if (cursor.index == run.listing.entries.size()) return false;
+        cursor.current = run.listing.entries[cursor.index++];
+        return true;
+    }
+    // Makes at least @p needed unread bytes available, if the run has them
+    auto fill = [&](size_t needed) {
+        if (cursor.buffer.size() - cursor.buffer_offset >= needed) return true;
+        cursor.buffer.erase(0, cursor.buffer_offset);
+        cursor.buffer_offset = 0;
+        size_t wanted = std::min<uint64_t>(
+            std::max(needed, READ_BUFFER_SIZE), run.file_end - cursor.file_position
+        );
+        size_t start = cursor.buffer.size();
+        cursor.buffer.resize(start + wanted);
+        size_t bytes_read = 0;
+        if (std::fseek(spill_file, static_cast<long>(cursor.file_position), SEEK_SET) == 0)
+            bytes_read = std::fread(cursor.buffer.data() + start, 1, wanted, spill_file);
+        cursor.buffer.resize(start + bytes_read);
+        cursor.file_position += bytes_read;
+        return cursor.buffer.size() >= needed;
+    };
+    if (!fill(RECORD_HEADER_SIZE)) return false;
+    const char* header = cursor.buffer.data() + cursor.buffer_offset;
+    EntryType type = static_cast<EntryType>(header[0]);
+    uint64_t inode;
+    uint16_t length;
+    std::memcpy(&inode, header + 1, sizeof(inode));
+    std::memcpy(&length, header + 1 + sizeof(inode), sizeof(length));
+    if (!fill(RECORD_HEADER_SIZE + length)) return false;
+    cursor.name.assign(cursor.buffer, cursor.buffer_offset + RECORD_HEADER_SIZE, length);
+    cursor.buffer_offset += RECORD_HEADER_SIZE + length;
+    cursor.current = make_listed_entry(cursor.name, type, inode);
+    return true;
+}
+
+void ExternalSort::start_merge() {
+    // Reserved up front: the current entries point into the cursors' names
+    cursors.reserve(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        cursors.emplace_back();
+        cursors.back().run = i;
+        cursors.back().file_position = runs[i]->file_offset;
+    }
+    for (size_t i = 0; i < cursors.size(); i++) {
+        if (advance(cursors[i])) heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) {
+        return entry_name_less(cursors[b].current, cursors[a].current);
+    });
+}
+
+bool ExternalSort::next_window(const OpenDirectory& directory, DirectoryListing& window) {
+    // The last window stays in place, with its "… (N more)" count
+    if (finished) return false;
+    window = DirectoryListing();
+    auto later = [this](size_t a, size_t b) {
+        return entry_name_less(cursors[b].current, cursors[a].current);
+    };
+    size_t cap = options.max_entries_per_directory;
+    window.entries.reserve(WINDOW_SIZE);
+    while (!heap.empty() && window.entries.size() < WINDOW_SIZE && !(cap && handed_out == cap)) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        size_t smallest = heap.back();
+        heap.pop_back();
+        ListedEntry entry = cursors[smallest].current;
+        entry.name = window.names.store(entry.name);
+        window.entries.push_back(entry);
+        handed_out++;
+        if (advance(cursors[smallest])) {
+            heap.push_back(smallest);
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+    if (heap.empty() || (cap && handed_out == cap)) {
+        finished = true;
+        window.omitted_count = total_count - handed_out;
+    }
+    if (options.metadata_fields) {
+        PhaseTimer stat_timer(PHASE_STAT);
+        read_listing_metadata(directory, window, options.metadata_fields, options.batch_metadata);
+    }
+    read_link_targets(directory, window);
+    return !window.entries.empty() || window.omitted_count > 0;
+}
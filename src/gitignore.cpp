@@ -0,0 +1,150 @@
+#include "../include/gitignore.hpp"
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+
+/**
+ * @brief Parses one line of a gitignore file.
+ *
+ * Handles comments, '!' negation, a trailing '/' for directory-only rules,
+ * unescaped trailing spaces and "**" segments. A pattern containing a '/'
+ * anywhere but at its end is anchored to the file's directory.
+ *
+ * @param line The line without its newline.
+ * @param rule Receives the parsed rule.
+ * @return false for blank lines and comments.
+ */
+bool parse_gitignore_line(string_view line, GitignoreRule& rule) {
+    rule = GitignoreRule();
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    // Trailing spaces are dropped unless escaped with a backslash
+    while (!line.empty() && line.back() == ' '
+        && !(line.size() >= 2 && line[line.size() - 2] == '\\'))
+        line.remove_suffix(1);
+    if (line.empty() || line.front() == '#') return false;
+    if (line.front() == '!') {
+        rule.negated = true;
+        line.remove_prefix(1);
+    }
+    if (!line.empty() && line.back() == '/') {
+        rule.directory_only = true;
+        line.remove_suffix(1);
+    }
+    if (line.empty()) return false;
+    rule.anchored = line.find('/') != string_view::npos;
+    if (line.front() == '/')
+        line.remove_prefix(1);
+    while (true) {
+        size_t slash = line.find('/');
+        string_view segment = line.substr(0, slash);
+        rule.globstar.push_back(segment == "**");
+        rule.segments.emplace_back(segment);
+        if (slash == string_view::npos) break;
+        line.remove_prefix(slash + 1);
+    }
+    return true;
+}
+
+/**
+ * @brief Matches the segments of an anchored rule against a relative path.
+ *
+ * A "**" segment matches any number of path components; a trailing "**"
+ * needs at least one, so "dir" followed by a "**" segment matches what is
+ * inside dir, not dir itself.
+ */
+static bool match_segments(const GitignoreRule& rule, size_t index, string_view path) {
+    if (index == rule.segments.size()) return path.empty();
+    if (rule.globstar[index]) {
+        if (index + 1 == rule.segments.size()) return !path.empty();
+        while (true) {
+            if (match_segments(rule, index + 1, path)) return true;
+            size_t slash = path.find('/');
+            if (slash == string_view::npos) return false;
+            path.remove_prefix(slash + 1);
+        }
+    }
+    if (path.empty()) return false;
+    size_t slash = path.find('/');
+    string_view component = path.substr(0, slash);
+    string_view rest = (slash == string_view::npos) ? string_view() : path.substr(slash + 1);
+    return rule.segments[index].matches(component) && match_segments(rule, index + 1, rest);
+}
+
+/**
+ * @brief Whether a rule matches an entry.
+ *
+ * @param rule The rule.
+ * @param relative_path The entry's path relative to the rule file's directory.
+ * @param name The entry's name.
+ * @param is_directory Whether the entry is a directory.
+ */
+bool gitignore_rule_matches(
+    const GitignoreRule& rule,
+    string_view relative_path,
+    string_view name,
+    bool is_directory
+) {
+    if (rule.directory_only && !is_directory) return false;
+    if (!rule.anchored) return rule.segments.front().matches(name);
+    return match_segments(rule, 0, relative_path);
+}
+
+/**
+ * @brief Appends the rules of a gitignore-style file in a directory.
+ */
+void GitignoreScope::load_rules(const OpenDirectory& directory, string_view file_name) {
+    string contents;
+    if (!read_directory_file(directory, file_name, contents)) return;
+    string_view remaining(contents);
+    while (!remaining.empty()) {
+        size_t newline = remaining.find('\n');
+        GitignoreRule rule;
+        if (parse_gitignore_line(remaining.substr(0, newline), rule))
+            rules.push_back(std::move(rule));
+        if (newline == string_view::npos) break;
+        remaining.remove_prefix(newline + 1);
+    }
+}
+
+shared_ptr<const GitignoreScope> GitignoreScope::open_root(const OpenDirectory& directory) {
+    auto scope = make_shared<GitignoreScope>();
+    // Later rules win, so the exclude file goes first
+    scope->load_rules(directory, ".git/info/exclude");
+    scope->load_rules(directory, ".gitignore");
+    return scope;
+}
+
+shared_ptr<const GitignoreScope> GitignoreScope::open_subdirectory(
+    const shared_ptr<const GitignoreScope>& parent,
+    const OpenDirectory& directory,
+    string_view name
+) {
+    auto scope = make_shared<GitignoreScope>();
+    scope->parent = parent;
+    scope->relative_path = parent->relative_path;
+    scope->relative_path.append(name);
+    scope->relative_path += '/';
+    scope->load_rules(directory, ".gitignore");
+    return scope;
+}
+
+bool GitignoreScope::is_ignored(string_view name, bool is_directory) const {
+    // Path of the entry below the root, built only if an anchored rule needs it
+    string entry_path;
+    for (const GitignoreScope* scope = this; scope; scope = scope->parent.get()) {
+        for (auto rule = scope->rules.rbegin(); rule != scope->rules.rend(); ++rule) {
+            string_view relative;
+            if (rule->anchored) {
+                if (entry_path.empty())
+                    entry_path = relative_path + string(name);
+                relative = string_view(entry_path).substr(scope->relative_path.size());
+            }
+            if (gitignore_rule_matches(*rule, relative, name, is_directory))
+                return !rule->negated;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,513 @@
+#include "../include/hierarchy.hpp"
+#include "../include/entry_sort.hpp"
+#include "../include/external_sort.hpp"
+#include "../include/run_stats.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::string;
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Validates the given path and handles it if it's a file or invalid.
+ *
+ * If the path is a file, it increments the file count, prints the file, and returns false
+ * to indicate further processing should stop. If the path is invalid, it logs an error and
+ * also returns false. If the path is a valid directory, it returns true to allow further processing.
+ *
+ * @param path The path to validate.
+ * @param state The rendering state holding the counters.
+ * @param depth The current depth in the directory hierarchy.
+ * @return true if the path is a valid directory, false otherwise.
+ */
+bool path_is_valid(
+    const string& path,
+    HierarchyState& state,
+    unsigned int depth
+) {
+    if (path.empty()) {
+        cerr << "Error: Path is empty!" << endl;
+        return false;
+    }
+    // Check if the path is a file
+    if (fs::is_regular_file(path)) {
+        // Increment file count
+        state.file_count++;
+        // Print the file as a single entry
+        state.emitter.write_entry(path, depth, false, true, nullptr);
+        return false; // Path is a file
+    }
+    // Check if the path is a directory
+    if (!fs::is_directory(path)) {
+        cerr << "Error: Path '" << path << "' is neither a file nor a directory!" << endl;
+        return false; // Invalid path
+    }
+    return true; // Path is a valid directory
+}
+
+/**
+ * @brief Keeps the first entries of an oversized listing.
+ *
+ * Picks the entries that sort first (or come first, when unsorted) with
+ * nth_element, so the rest is never sorted, and resolves symlinks only for
+ * the picked entries. Entries that turn out not to be listable are dropped
+ * and the selection is topped up from the rest. Whatever is left over is
+ * only counted, including unresolved entries.
+ *
+ * @param listing The listing to cap; its omitted_count is set.
+ * @param directory The directory the listing was read from.
+ * @param cap The number of entries to keep.
+ * @param sort_entries Whether the kept entries must be the first by name.
+ * @param follow_links Whether symlinks are listed as what they point to.
+ */
+static void keep_first_entries(
+    DirectoryListing& listing,
+    const OpenDirectory& directory,
+    size_t cap,
+    bool sort_entries,
+    bool follow_links
+) {
+    vector<ListedEntry>& entries = listing.entries;
+    size_t kept = 0;
+    while (kept < cap && kept < entries.size()) {
+        size_t wanted = std::min(cap - kept, entries.size() - kept);
+        auto first = entries.begin() + kept;
+        if (sort_entries && entries.size() - kept > wanted)
+            std::nth_element(first, first + wanted, entries.end(), entry_name_less);
+        // Move the listable picks forward, keeping their order
+        size_t listable = kept;
+        for (size_t i = kept; i < kept + wanted; i++) {
+            if (resolve_entry_type(directory, entries[i], follow_links))
+                std::swap(entries[listable++], entries[i]);
+        }
+        entries.erase(entries.begin() + listable, entries.begin() + kept + wanted);
+        kept = listable;
+    }
+    listing.omitted_count = entries.size() - kept;
+    entries.resize(kept);
+    if (sort_entries)
+        sort_entries_by_name(entries);
+}
+
+/**
+ * @brief Drops the entries whose names match, or (with @p files_only) the
+ * files whose names do not.
+ *
+ * The whole listing is matched in one batch, see IgnoreMatcher::match_entries().
+ */
+static void filter_listing(
+    vector<ListedEntry>& entries,
+    const IgnoreMatcher& matcher,
+    bool files_only
+) {
+    if (matcher.empty()) return;
+    vector<uint8_t> matched;
+    matcher.match_entries(entries, matched);
+    size_t kept = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        bool keep = files_only ? (matched[i] || entries[i].is_directory()) : !matched[i];
+        if (keep) entries[kept++] = entries[i];
+    }
+    entries.resize(kept);
+}
+
+/**
+ * @brief Drops the entries of a raw listing that are not printed.
+ *
+ * Applies the filters of read_directory_listing() in the same order, but
+ * no --max-entries-per-dir limit: ignored names first, then entries that
+ * are neither files, directories nor links, --match and .gitignore rules.
+ *
+ * @param listing The entries as read by the backend.
+ * @param directory The directory they were read from.
+ * @param options The ignore settings of the current run.
+ * @param gitignore The .gitignore rules of the directory, or nullptr.
+ */
+void filter_directory_entries(
+    DirectoryListing& listing,
+    const OpenDirectory& directory,
+    const HierarchyOptions& options,
+    const GitignoreScope* gitignore
+) {
+    filter_listing(listing.entries, options.ignore, false);
+    {
+        PhaseTimer stat_timer(PHASE_STAT);
+        std::erase_if(listing.entries, [&](ListedEntry& entry) {
+            return !resolve_entry_type(directory, entry, options.follow_links);
+        });
+        filter_listing(listing.entries, options.match, true);
+    }
+    if (gitignore) {
+        std::erase_if(listing.entries, [&](const ListedEntry& entry) {
+            return gitignore->is_ignored(entry.name, entry.is_directory());
+        });
+    }
+}
+
+/**
+ * @brief Reads, filters and optionally sorts the entries of a directory.
+ *
+ * The directory is read once through its descriptor, or replayed from the
+ * snapshot. Only entries that are not printed are dropped (see
+ * filter_directory_entries()), so the size of the result decides which
+ * entry gets the last-entry marker. Touches no rendering state and is
+ * therefore safe to call from worker threads.
+ *
+ * @param directory The open directory to read; its descriptor also serves
+ * the fd-relative stat and readlink calls.
+ * @param options The backend, sorting, filter, limit and metadata settings
+ * of the current run.
+ * @param gitignore The .gitignore rules in effect in the directory, or
+ * nullptr to apply none.
+ * @param snapshot The snapshot to replay the directory from when it did not
+ * change, or nullptr to always read it.
+ * @param external Receives the ExternalSort of a sorted directory with more
+ * than sort_chunk_entries entries, whose first window is returned; nullptr
+ * to always sort in memory.
+ * @return The listable entries of the directory.
+ */
+DirectoryListing read_directory_listing(
+    const OpenDirectory& directory,
+    const HierarchyOptions& options,
+    const GitignoreScope* gitignore,
+    SnapshotCache* snapshot,
+    std::unique_ptr<ExternalSort>* external
+) {
+    DirectoryListing listing;
+    bool complete = true;
+    {
+        PhaseTimer read_timer(PHASE_READ);
+        size_t chunk_entries = (external && options.sort_entries) ? options.sort_chunk_entries : 0;
+        // Snapshots hold every entry, so they serve any set of ignore rules
+        if (snapshot)
+            snapshot->read_entries(directory, options.backend, listing);
+        else
+            complete = read_directory_entries(directory, options.backend, {}, listing, chunk_entries);
+    }
+    if (!complete) {
+        // Too large to sort in one piece; sorted in chunks and merged
+        *external = std::make_unique<ExternalSort>(options, gitignore);
+        (*external)->read_runs(directory, listing);
+        (*external)->next_window(directory, listing);
+        return listing;
+    }
+    {
+        PhaseTimer read_timer(PHASE_READ);
+        // Ignored names go in one batch before any entry is stat'ed, so
+        // ignored subtrees are never opened
+        filter_listing(listing.entries, options.ignore, false);
+    }
+    size_t cap = options.max_entries_per_directory;
+    bool capped = cap != 0 && listing.entries.size() > cap;
+    // Directory-only .gitignore rules and --match need every entry's type
+    if (!capped || gitignore || !options.match.empty()) {
+        PhaseTimer stat_timer(PHASE_STAT);
+        std::erase_if(listing.entries, [&](ListedEntry& entry) {
+            return !resolve_entry_type(directory, entry, options.follow_links);
+        });
+        filter_listing(listing.entries, options.match, true);
+        capped = cap != 0 && listing.entries.size() > cap;
+    }
+    // .gitignore rules apply after classification; pruned directories are
+    // still never opened
+    if (gitignore) {
+        std::erase_if(listing.entries, [&](const ListedEntry& entry) {
+            return gitignore->is_ignored(entry.name, entry.is_directory());
+        });
+        capped = cap != 0 && listing.entries.size() > cap;
+    }
+    if (capped) {
+        keep_first_entries(listing, directory, cap, options.sort_entries, options.follow_links);
+    } else if (options.sort_entries) {
+        // Sort entries if the flag is enabled
+        sort_entries_by_name(listing.entries);
+    }
+    // Only the entries that are printed cost a stat, and only when asked
+    if (options.metadata_fields) {
+        PhaseTimer stat_timer(PHASE_STAT);
+        read_listing_metadata(directory, listing, options.metadata_fields, options.batch_metadata);
+    }
+    read_link_targets(directory, listing);
+    return listing;
+}
+
+/**
+ * @brief Prints the line naming the root directory.
+ *
+ * The root shows the path as given, always ending with '/'. Every other
+ * directory is written by process_directory_entries().
+ *
+ * @param name The root path.
+ * @param state The rendering state holding the emitter.
+ * @param depth The current depth in the directory hierarchy.
+ */
+void print_directory_header(
+    std::string_view name,
+    HierarchyState& state,
+    unsigned int depth
+) {
+    state.emitter.write_entry(name, depth, true, true, nullptr);
+}
+
+/**
+ * @brief Prints an entry of a listing and counts it.
+ *
+ * Symlinks that are not followed are written as links and count as files.
+ *
+ * @param listing The listing holding the entry.
+ * @param index The entry's index in the listing.
+ * @param state The rendering state holding the emitter and counters.
+ * @param depth The depth of the entry.
+ * @param is_last Whether nothing follows the entry in its directory.
+ */
+void print_listed_entry(
+    const DirectoryListing& listing,
+    size_t index,
+    HierarchyState& state,
+    unsigned int depth,
+    bool is_last
+) {
+    const ListedEntry& entry = listing.entries[index];
+    const EntryMetadata* metadata = listing.metadata.empty() ? nullptr : &listing.metadata[index];
+    if (entry.is_link()) {
+        state.emitter.write_link(entry.name, listing.link_targets[index], depth, is_last, metadata);
+    } else {
+        state.emitter.write_entry(entry.name, depth, entry.is_directory(), is_last, metadata);
+    }
+    if (entry.is_directory()) {
+        state.directory_count++;
+    } else {
+        state.file_count++;
+    }
+}
+
+/**
+ * @brief Records a directory that is about to be walked, with --follow-links.
+ *
+ * Directories whose device and inode cannot be read are never entered, so
+ * a walk that follows links always ends.
+ *
+ * @return false if the directory was entered before, through another path.
+ */
+bool enter_directory_once(const OpenDirectory& directory, HierarchyState& state) {
+    uint64_t device;
+    uint64_t inode;
+    if (!directory_identity(directory, device, inode)) return false;
+    return state.visited_directories.insert(device, inode);
+}
+
+/**
+ * @brief Prints the last line of a directory cut off by --max-entries-per-dir.
+ *
+ * @param omitted_count The number of entries that were not printed.
+ * @param state The rendering state holding the emitter.
+ * @param depth The depth of the listed entries.
+ */
+void print_omitted_entries(
+    size_t omitted_count,
+    HierarchyState& state,
+    unsigned int depth
+) {
+    state.emitter.write_omitted(omitted_count, depth);
+}
+
+/**
+ * @brief Prints a tree of directory listings that were already read.
+ *
+ * Every entry is written here; right after a subdirectory has been written
+ * it is handed to @p enter_subdirectory, whose listing (if any) is printed
+ * next, below it. This lets the walkers that read ahead share the same
+ * rendering order. The entered listings form an explicit stack, so the
+ * depth of the tree is not limited by the call stack. Entries cut off by
+ * --max-entries-per-dir are summarized in a final line.
+ *
+ * @param listing The filtered entries of the top directory.
+ * @param state The rendering state holding the emitter and counters.
+ * @param depth The depth of the listed entries.
+ * @param enter_subdirectory Called for every subdirectory, in order.
+ * @param leave_subdirectory Called when done with each entered subdirectory.
+ */
+void process_directory_entries(
+    const DirectoryListing& listing,
+    HierarchyState& state,
+    unsigned int depth,
+    const SubdirectoryVisitor& enter_subdirectory,
+    const SubdirectoryLeaver& leave_subdirectory
+) {
+    struct Level {
+        const DirectoryListing* listing;
+        size_t index = 0;               ///< The next entry to print.
+        size_t subdirectory_index = 0;  ///< Directories among the entries printed so far.
+    };
+    vector<Level> levels;
+    levels.push_back({&listing});
+    // Start the entries of the listed directory's level
+    state.emitter.begin_entries(depth - 1);
+    while (!levels.empty()) {
+        Level& level = levels.back();
+        const DirectoryListing& current = *level.listing;
+        unsigned int entry_depth = depth + levels.size() - 1;
+        bool has_summary = current.omitted_count > 0;
+        if (level.index == current.entries.size()) {
+            // Summarize the entries cut off by --max-entries-per-dir
+            if (has_summary)
+                print_omitted_entries(current.omitted_count, state, entry_depth);
+            state.emitter.end_entries();
+            levels.pop_back();
+            if (!levels.empty()) leave_subdirectory();
+            continue;
+        }
+        size_t i = level.index++;
+        bool is_last = i + 1 == current.entries.size() && !has_summary;
+        print_listed_entry(current, i, state, entry_depth, is_last);
+        if (!current.entries[i].is_directory()) continue;
+        const DirectoryListing* subdirectory
+            = enter_subdirectory(current.entries[i], level.subdirectory_index++);
+        if (!subdirectory) continue;
+        state.emitter.begin_entries(entry_depth);
+        levels.push_back({subdirectory});
+    }
+}
+
+namespace {
+
+/**
+ * @struct WalkFrame
+ * @brief A directory whose entries the serial walker is printing.
+ */
+struct WalkFrame {
+    OpenDirectory directory = {};
+    std::shared_ptr<const GitignoreScope> gitignore = {};
+    DirectoryListing listing = {}; ///< The entries, or the current window of an external sort.
+    std::unique_ptr<ExternalSort> external = {}; ///< Set for directories sorted in chunks.
+    size_t index = 0; ///< The next entry to print.
+    bool released = false; ///< Whether the descriptor is closed until the walk returns here.
+};
+
+}
+
+/**
+ * @brief Prints the entries of a directory known to exist, depth-first.
+ *
+ * Subdirectories come straight from a listing, so they are not validated
+ * (and stat'ed) a second time. Each one is opened relative to its parent.
+ * The directories being walked form an explicit stack, so the depth of the
+ * tree is not limited by the call stack; only the open_directory_limit()
+ * deepest ones keep their descriptors, and the ones above are reopened
+ * through ".." on the way back up. With --follow-links, a directory
+ * reached a second time (through a link, or a link cycle) is shown
+ * without its entries.
+ *
+ * @param directory The open directory.
+ * @param gitignore The .gitignore rules of the directory, or nullptr.
+ * @param options The spacing, sorting and ignore settings of the current run.
+ * @param state The rendering state holding the emitter and counters.
+ * @param depth The depth of the directory in the hierarchy.
+ */
+static void walk_directory(
+    OpenDirectory directory,
+    std::shared_ptr<const GitignoreScope> gitignore,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int depth
+) {
+    size_t open_limit = open_directory_limit();
+    vector<WalkFrame> stack;
+    stack.push_back({std::move(directory), std::move(gitignore)});
+    stack.back().listing = read_directory_listing(
+        stack.back().directory, options, stack.back().gitignore.get(), state.snapshot,
+        &stack.back().external
+    );
+    state.emitter.begin_entries(depth);
+    while (!stack.empty()) {
+        WalkFrame& frame = stack.back();
+        unsigned int entry_depth = depth + stack.size();
+        size_t entry_count = frame.listing.entries.size();
+        // A directory sorted in chunks is printed one window at a time
+        if (frame.index == entry_count && frame.external && frame.external->next_window(frame.directory, frame.listing)) {
+            frame.index = 0;
+            continue;
+        }
+        if (frame.index == entry_count) {
+            // Summarize the entries cut off by --max-entries-per-dir
+            if (frame.listing.omitted_count > 0)
+                print_omitted_entries(frame.listing.omitted_count, state, entry_depth);
+            state.emitter.end_entries();
+            if (stack.size() > 1 && stack[stack.size() - 2].released) {
+                reacquire_directory(stack[stack.size() - 2].directory, frame.directory);
+                stack[stack.size() - 2].released = false;
+            }
+            stack.pop_back();
+            continue;
+        }
+        size_t i = frame.index++;
+        bool is_last = i + 1 == entry_count && frame.listing.omitted_count == 0
+            && !(frame.external && !frame.external->done());
+        print_listed_entry(frame.listing, i, state, entry_depth, is_last);
+        const ListedEntry& entry = frame.listing.entries[i];
+        // Below the depth limit, directories are shown but never opened
+        if (!entry.is_directory() || !lists_entries_at(options, entry_depth)) continue;
+        OpenDirectory subdirectory = open_subdirectory(frame.directory, entry.name, options.backend);
+        if (options.follow_links && !enter_directory_once(subdirectory, state)) continue;
+        std::shared_ptr<const GitignoreScope> subdirectory_gitignore;
+        if (frame.gitignore)
+            subdirectory_gitignore = GitignoreScope::open_subdirectory(
+                frame.gitignore, subdirectory, entry.name
+            );
+        WalkFrame child{std::move(subdirectory), std::move(subdirectory_gitignore)};
+        child.listing = read_directory_listing(
+            child.directory, options, child.gitignore.get(), state.snapshot, &child.external
+        );
+        state.emitter.begin_entries(entry_depth);
+        stack.push_back(std::move(child));
+        // Only the directories nearest the bottom of a deep path stay open;
+        // a chunk-sorted directory keeps reading windows, so it is never released
+        if (stack.size() > open_limit) {
+            WalkFrame& upper = stack[stack.size() - open_limit - 1];
+            if (!upper.released && !upper.external)
+                upper.released = release_directory(
+                    upper.directory, stack[stack.size() - open_limit].directory
+                );
+        }
+    }
+}
+
+/**
+ * @brief Generates and prints the directory hierarchy.
+ *
+ * @param path The current directory path.
+ * @param options The spacing, sorting and ignore settings of the current run.
+ * @param state The rendering state holding the level states and counters.
+ * @param depth The current depth in the directory hierarchy.
+ */
+void generate_directory_hierarchy(
+    string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int depth
+) {
+    // Validate the path
+    if (!path_is_valid(path, state, depth)) return;
+    OpenDirectory directory = open_root_directory(path, options.backend);
+    if (options.follow_links) enter_directory_once(directory, state);
+    std::shared_ptr<const GitignoreScope> gitignore;
+    if (options.use_gitignore)
+        gitignore = GitignoreScope::open_root(directory);
+    // Print the directory itself
+    print_directory_header(path, state, depth);
+    walk_directory(std::move(directory), std::move(gitignore), options, state, depth);
+}
+
+/**
+ * @brief Prints the closing line with the directory and file counts.
+ *
+ * @param state The rendering state holding the counters.
+ */
+void print_summary(HierarchyState& state) {
+    state.emitter.write_summary(state.directory_count, state.file_count);
+}
@@ -0,0 +1,265 @@
+#include "../include/ignore_matcher.hpp"
+#include "../include/byte_search.hpp"
+#include <algorithm>
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+bool GlobPattern::has_wildcards(string_view pattern) {
+    return pattern.find_first_of("*?[\\") != string_view::npos;
+}
+
+/**
+ * @brief Compiles a pattern into literal, wildcard and class tokens.
+ *
+ * An unterminated '[' is taken literally, like fnmatch(3) does.
+ */
+GlobPattern::GlobPattern(string_view pattern) {
+    size_t i = 0;
+    auto append_literal = [this](char c) {
+        if (tokens.empty() || tokens.back().kind != LITERAL)
+            tokens.push_back({LITERAL, "", false});
+        tokens.back().text += c;
+    };
+    while (i < pattern.size()) {
+        char c = pattern[i];
+        if (c == '*') {
+            // Consecutive stars behave like one
+            if (tokens.empty() || tokens.back().kind != ANY_RUN)
+                tokens.push_back({ANY_RUN, "", false});
+            i++;
+        } else if (c == '?') {
+            tokens.push_back({ANY_CHAR, "", false});
+            i++;
+        } else if (c == '\\' && i + 1 < pattern.size()) {
+            append_literal(pattern[i + 1]);
+            i += 2;
+        } else if (c == '[') {
+            size_t j = i + 1;
+            Token token{CHAR_CLASS, "", false};
+            if (j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^')) {
+                token.negated = true;
+                j++;
+            }
+            // A ']' right after the opening bracket is a member
+            bool first = true;
+            while (j < pattern.size() && (pattern[j] != ']' || first)) {
+                char low = pattern[j];
+                char high = low;
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                    high = pattern[j + 2];
+                    j += 2;
+                }
+                token.text += low;
+                token.text += high;
+                j++;
+                first = false;
+            }
+            if (j >= pattern.size()) { // Unterminated, treat '[' literally
+                append_literal('[');
+                i++;
+                continue;
+            }
+            tokens.push_back(token);
+            i = j + 1;
+        } else {
+            append_literal(c);
+            i++;
+        }
+    }
+}
+
+/**
+ * @brief Matches a single non-star token at a position and advances it.
+ */
+bool GlobPattern::token_matches(const Token& token, string_view name, size_t& position) const {
+    switch (token.kind) {
+        case LITERAL:
+            if (name.compare(position, token.text.size(), token.text) != 0) return false;
+            position += token.text.size();
+            return true;
+        case ANY_CHAR:
+            if (position >= name.size()) return false;
+            position++;
+            return true;
+        case CHAR_CLASS: {
+            if (position >= name.size()) return false;
+            unsigned char c = name[position];
+            bool member = false;
+            for (size_t k = 0; k + 1 < token.text.size(); k += 2) {
+                if (c >= static_cast<unsigned char>(token.text[k])
+                    && c <= static_cast<unsigned char>(token.text[k + 1])) {
+                    member = true;
+                    break;
+                }
+            }
+            if (member == token.negated) return false;
+            position++;
+            return true;
+        }
+        case ANY_RUN:
+            break;
+    }
+    return false;
+}
+
+/**
+ * @brief Matches the whole name against the pattern.
+ *
+ * Classic single-backtrack wildcard matching: on a mismatch only the most
+ * recent '*' is widened, which keeps matching linear in practice.
+ */
+bool GlobPattern::matches(string_view name) const {
+    size_t token_index = 0;
+    size_t position = 0;
+    size_t star_token = tokens.size();
+    size_t star_position = 0;
+    while (true) {
+        if (token_index < tokens.size() && tokens[token_index].kind == ANY_RUN) {
+            star_token = token_index++;
+            star_position = position;
+            continue;
+        }
+        if (token_index == tokens.size()) {
+            if (position == name.size()) return true;
+        } else {
+            size_t next = position;
+            if (token_matches(tokens[token_index], name, next)) {
+                token_index++;
+                position = next;
+                continue;
+            }
+        }
+        // Let the last star swallow one more byte and retry
+        if (star_token == tokens.size() || star_position >= name.size())
+            return false;
+        token_index = star_token + 1;
+        position = ++star_position;
+    }
+}
+
+/**
+ * @brief Compiles the names and patterns given to --ignore.
+ *
+ * @param patterns Plain names or shell-style wildcard patterns.
+ */
+IgnoreMatcher::IgnoreMatcher(const vector<string>& patterns) {
+    for (const auto& pattern : patterns) {
+        if (!GlobPattern::has_wildcards(pattern)) {
+            exact_names.insert(pattern);
+            continue;
+        }
+        string_view body(pattern);
+        // "prefix*", "*suffix" and "*text*" need no general matcher
+        if (body.size() > 2 && body.front() == '*' && body.back() == '*'
+            && !GlobPattern::has_wildcards(body.substr(1, body.size() - 2))) {
+            substrings.emplace_back(body.substr(1, body.size() - 2));
+        } else if (body.size() > 1 && body.back() == '*'
+            && !GlobPattern::has_wildcards(body.substr(0, body.size() - 1))) {
+            prefixes.emplace_back(body.substr(0, body.size() - 1));
+        } else if (body.size() > 1 && body.front() == '*'
+            && !GlobPattern::has_wildcards(body.substr(1))) {
+            suffixes.emplace_back(body.substr(1));
+        } else {
+            globs.emplace_back(body);
+        }
+    }
+}
+
+bool IgnoreMatcher::matches(string_view name) const {
+    if (!exact_names.empty() && exact_names.find(name) != exact_names.end())
+        return true;
+    for (const auto& prefix : prefixes)
+        if (name.starts_with(prefix)) return true;
+    for (const auto& suffix : suffixes)
+        if (name.ends_with(suffix)) return true;
+    for (const auto& substring : substrings)
+        if (find_bytes(name, substring) != string_view::npos) return true;
+    for (const auto& glob : globs)
+        if (glob.matches(name)) return true;
+    return false;
+}
+
+void IgnoreMatcher::match_entries(
+    const vector<ListedEntry>& entries,
+    vector<uint8_t>& matched
+) const {
+    matched.assign(entries.size(), 0);
+    if (!exact_names.empty()) {
+        for (size_t i = 0; i < entries.size(); i++)
+            if (exact_names.find(entries[i].name) != exact_names.end()) matched[i] = 1;
+    }
+    // Prefixes and suffixes only look at the ends of each name
+    if (!prefixes.empty() || !suffixes.empty()) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (matched[i]) continue;
+            string_view name = entries[i].name;
+            for (const auto& prefix : prefixes)
+                if (name.starts_with(prefix)) matched[i] = 1;
+            for (const auto& suffix : suffixes)
+                if (name.ends_with(suffix)) matched[i] = 1;
+        }
+    }
+    if (!substrings.empty()) {
+        // Names as long as a vector search step are searched on their own
+        size_t name_bytes = 0;
+        for (const auto& entry : entries)
+            name_bytes += entry.name.size();
+        if (entries.size() < JOIN_THRESHOLD || name_bytes >= entries.size() * JOIN_NAME_LENGTH) {
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (matched[i]) continue;
+                for (const auto& substring : substrings)
+                    if (find_bytes(entries[i].name, substring) != string_view::npos) matched[i] = 1;
+            }
+        } else {
+            match_joined_substrings(entries, matched);
+        }
+    }
+    if (!globs.empty()) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (matched[i]) continue;
+            for (const auto& glob : globs) {
+                if (glob.matches(entries[i].name)) {
+                    matched[i] = 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Finds every substring rule in one pass over the joined names.
+ *
+ * The names are joined as "/name0/name1/.../", so a hit never spans two
+ * names; after a hit the search resumes at the next name.
+ */
+void IgnoreMatcher::match_joined_substrings(
+    const vector<ListedEntry>& entries,
+    vector<uint8_t>& matched
+) const {
+    // Reused across directories, so joining only copies bytes
+    thread_local string joined;
+    thread_local vector<size_t> starts;
+    joined.assign(1, '/');
+    starts.clear();
+    for (const auto& entry : entries) {
+        starts.push_back(joined.size());
+        joined.append(entry.name);
+        joined += '/';
+    }
+    for (const auto& substring : substrings) {
+        // A rule containing '/' never matches a name
+        if (substring.find('/') != string::npos) continue;
+        size_t from = 0;
+        auto first = starts.begin();
+        size_t position;
+        while ((position = find_bytes(joined, substring, from)) != string_view::npos) {
+            first = std::upper_bound(first, starts.end(), position) - 1;
+            size_t index = first - starts.begin();
+            matched[index] = 1;
+            from = *first + entries[index].name.size();
+        }
+    }
+}
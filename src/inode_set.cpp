@@ -0,0 +1,69 @@
+#include "../include/inode_set.hpp"
+#include <algorithm>
+
+using std::vector;
+
+// Tables are grown before more than 3/4 of their slots are used.
+static constexpr size_t INITIAL_CAPACITY = 64;
+
+/**
+ * @brief The first slot probed for a pair.
+ *
+ * Inode numbers are often dense, so they are mixed before masking.
+ */
+size_t InodeSet::slot_index(uint64_t device, uint64_t inode) const {
+    uint64_t hash = inode ^ (device * 0x9e3779b97f4a7c15ULL);
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash & (slots.size() - 1);
+}
+
+bool InodeSet::insert(uint64_t device, uint64_t inode) {
+    if (inode == 0) {
+        if (contains(device, inode)) return false;
+        zero_inode_devices.push_back(device);
+        count++;
+        return true;
+    }
+    // Only pairs in the table count towards its load
+    if ((count - zero_inode_devices.size() + 1) * 4 > slots.size() * 3) grow();
+    for (size_t i = slot_index(device, inode);; i = (i + 1) & (slots.size() - 1)) {
+        Slot& slot = slots[i];
+        if (slot.inode == 0) {
+            slot.device = device;
+            slot.inode = inode;
+            count++;
+            return true;
+        }
+        if (slot.inode == inode && slot.device == device) return false;
+    }
+}
+
+bool InodeSet::contains(uint64_t device, uint64_t inode) const {
+    if (inode == 0) {
+        return std::find(zero_inode_devices.begin(), zero_inode_devices.end(), device)
+            != zero_inode_devices.end();
+    }
+    if (slots.empty()) return false;
+    for (size_t i = slot_index(device, inode);; i = (i + 1) & (slots.size() - 1)) {
+        const Slot& slot = slots[i];
+        if (slot.inode == 0) return false;
+        if (slot.inode == inode && slot.device == device) return true;
+    }
+}
+
+/**
+ * @brief Doubles the table and reinserts every pair.
+ */
+void InodeSet::grow() {
+    vector<Slot> old = std::move(slots);
+    slots.assign(old.empty() ? INITIAL_CAPACITY : old.size() * 2, Slot());
+    for (const Slot& slot : old) {
+        if (slot.inode == 0) continue;
+        size_t i = slot_index(slot.device, slot.inode);
+        while (slots[i].inode != 0)
+            i = (i + 1) & (slots.size() - 1);
+        slots[i] = slot;
+    }
+}
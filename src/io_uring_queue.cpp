@@ -0,0 +1,112 @@
+#include "../include/io_uring_queue.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+
+/**
+ * @brief Sets up a queue pair with room for a number of submissions.
+ */
+IoUring::IoUring(unsigned int entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) return;
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mapping)
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        close(fd);
+        return;
+    }
+    cq_ring = single_mapping ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (cq_ring == MAP_FAILED) ? MAP_FAILED : mmap(nullptr, sqes_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = cq_ring = sqes = nullptr;
+        close(fd);
+        return;
+    }
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+    sq_entries = params.sq_entries;
+    ring_fd = fd;
+}
+
+IoUring::~IoUring() {
+    if (ring_fd < 0) return;
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+}
+
+io_uring_sqe* IoUring::next_submission() {
+    unsigned int head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    unsigned int tail = *sq_tail + pending;
+    if (tail - head >= sq_entries) return nullptr;
+    unsigned int slot = tail & *sq_mask;
+    auto* entry = static_cast<io_uring_sqe*>(sqes) + slot;
+    std::memset(entry, 0, sizeof(*entry));
+    sq_array[slot] = slot;
+    pending++;
+    return entry;
+}
+
+bool IoUring::submit_and_wait(unsigned int wait_count) {
+    // Publish the new entries before the kernel reads the tail
+    __atomic_store_n(sq_tail, *sq_tail + pending, __ATOMIC_RELEASE);
+    pending = 0;
+    while (true) {
+        // Entries the kernel already consumed are not counted again
+        unsigned int unsubmitted = *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        long result = syscall(__NR_io_uring_enter, ring_fd, unsubmitted, wait_count,
+            wait_count ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (result >= 0) return true;
+        if (errno != EINTR) {
+            // A failed call consumed nothing; withdraw the entries
+            __atomic_store_n(sq_tail, __atomic_load_n(sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+            return false;
+        }
+    }
+}
+
+bool IoUring::pop_completion(io_uring_cqe& completion) {
+    unsigned int head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return false;
+    completion = static_cast<io_uring_cqe*>(cqes)[head & *cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+IoUring::IoUring(unsigned int) {}
+
+IoUring::~IoUring() {}
+
+#endif
@@ -0,0 +1,298 @@
+#include "../include/json_emitter.hpp"
+#include <charconv>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string;
+using std::string_view;
+
+/**
+ * @brief Finds the first byte that JSON strings must escape.
+ *
+ * Scans 16 bytes at a time with SSE2 where available; names without
+ * quotes, backslashes or control characters, which is nearly all of them,
+ * never leave the vector loop.
+ *
+ * @return The index of the byte, or text.size() if there is none.
+ */
+static size_t find_escaped_byte(string_view text, size_t from) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i last_control = _mm_set1_epi8(0x1F);
+    for (; from + 16 <= text.size(); from += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + from));
+        // Unsigned chunk <= 0x1F exactly when min(chunk, 0x1F) == chunk
+        __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, last_control), chunk);
+        __m128i special = _mm_or_si128(
+            _mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)
+        );
+        int mask = _mm_movemask_epi8(_mm_or_si128(control, special));
+        if (mask != 0) return from + __builtin_ctz(mask);
+    }
+#endif
+    for (; from < text.size(); from++) {
+        unsigned char byte = text[from];
+        if (byte < 0x20 || byte == '"' || byte == '\\') return from;
+    }
+    return text.size();
+}
+
+/**
+ * @brief Writes the escaped contents of a JSON string, without quotes.
+ *
+ * Bytes from 0x80 up are passed through, so UTF-8 names stay readable;
+ * names that are not valid UTF-8 are written as they are.
+ */
+static void write_json_escaped(OutputBuffer& output, string_view text) {
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+    size_t start = 0;
+    while (true) {
+        size_t special = find_escaped_byte(text, start);
+        output.write(text.substr(start, special - start));
+        if (special == text.size()) return;
+        unsigned char byte = text[special];
+        switch (byte) {
+            case '"': output.write("\\\""); break;
+            case '\\': output.write("\\\\"); break;
+            case '\b': output.write("\\b"); break;
+            case '\f': output.write("\\f"); break;
+            case '\n': output.write("\\n"); break;
+            case '\r': output.write("\\r"); break;
+            case '\t': output.write("\\t"); break;
+            default: {
+                char escape[] = {'\\', 'u', '0', '0', HEX_DIGITS[byte >> 4], HEX_DIGITS[byte & 0xF]};
+                output.write(string_view(escape, sizeof(escape)));
+            }
+        }
+        start = special + 1;
+    }
+}
+
+/**
+ * @brief Writes a quoted, escaped JSON string.
+ *
+ * @param output The buffer receiving the string.
+ * @param text The raw bytes to encode.
+ */
+void write_json_string(OutputBuffer& output, string_view text) {
+    output.write("\"");
+    write_json_escaped(output, text);
+    output.write("\"");
+}
+
+template <typename Integer>
+static void write_json_number(OutputBuffer& output, Integer value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    output.write(string_view(digits, result.ptr - digits));
+}
+
+/**
+ * @brief Writes the ',"size":…,"mtime":…,"owner":…' members that were read.
+ *
+ * The modification time is given in whole seconds since the epoch.
+ */
+static void write_json_metadata(
+    OutputBuffer& output,
+    const EntryMetadata* metadata,
+    OwnerNames& owners
+) {
+    if (!metadata) return;
+    if (metadata->fields & METADATA_SIZE) {
+        output.write(",\"size\":");
+        write_json_number(output, metadata->size);
+    }
+    if (metadata->fields & METADATA_MTIME) {
+        output.write(",\"mtime\":");
+        write_json_number(output, mtime_seconds(*metadata));
+    }
+    if (metadata->fields & METADATA_OWNER) {
+        output.write(",\"owner\":");
+        write_json_string(output, owners.lookup(metadata->owner));
+    }
+    if (metadata->fields & METADATA_FILES) {
+        output.write(",\"files\":");
+        write_json_number(output, metadata->file_count);
+    }
+}
+
+static string_view json_type(bool is_directory) {
+    return is_directory ? "\"directory\"" : "\"file\"";
+}
+
+/**
+ * @brief Writes the separator and indentation in front of an array element.
+ */
+void JsonEmitter::start_element(unsigned int) {
+    if (directory_open) close_directory();
+    if (!started) {
+        sink.write("[");
+        started = true;
+    }
+    sink.write(first_element ? "\n" : ",\n");
+    first_element = false;
+    size_t width = 2 * (open_arrays + 1);
+    if (indentation.size() < width) indentation.resize(width, ' ');
+    sink.write(string_view(indentation).substr(0, width));
+}
+
+void JsonEmitter::close_directory() {
+    sink.write("}");
+    directory_open = false;
+}
+
+void JsonEmitter::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool,
+    const EntryMetadata* metadata
+) {
+    start_element(depth);
+    sink.write("{\"type\":");
+    sink.write(json_type(is_directory));
+    sink.write(",\"name\":");
+    write_json_string(sink, name);
+    write_json_metadata(sink, metadata, owners);
+    // A directory stays open in case its "contents" follow
+    if (is_directory) {
+        directory_open = true;
+    } else {
+        sink.write("}");
+    }
+}
+
+void JsonEmitter::write_link(
+    string_view name,
+    string_view target,
+    unsigned int depth,
+    bool,
+    const EntryMetadata* metadata
+) {
+    start_element(depth);
+    sink.write("{\"type\":\"link\",\"name\":");
+    write_json_string(sink, name);
+    sink.write(",\"target\":");
+    write_json_string(sink, target);
+    write_json_metadata(sink, metadata, owners);
+    sink.write("}");
+}
+
+void JsonEmitter::begin_entries(unsigned int) {
+    sink.write(",\"contents\":[");
+    directory_open = false;
+    first_element = true;
+    open_arrays++;
+}
+
+void JsonEmitter::end_entries() {
+    if (directory_open) close_directory();
+    if (!first_element) {
+        sink.write("\n");
+        sink.write(string_view(indentation).substr(0, 2 * open_arrays));
+    }
+    sink.write("]}");
+    open_arrays--;
+    first_element = false;
+}
+
+void JsonEmitter::write_omitted(size_t omitted_count, unsigned int depth) {
+    start_element(depth);
+    sink.write("{\"type\":\"omitted\",\"count\":");
+    write_json_number(sink, omitted_count);
+    sink.write("}");
+}
+
+void JsonEmitter::write_summary(unsigned int directory_count, unsigned int file_count) {
+    start_element(0);
+    sink.write("{\"type\":\"report\",\"directories\":");
+    write_json_number(sink, directory_count);
+    sink.write(",\"files\":");
+    write_json_number(sink, file_count);
+    sink.write("}\n]\n");
+}
+
+/**
+ * @brief Writes the "path" member of an entry below the listed directory.
+ */
+void NdjsonEmitter::write_path(string_view name) {
+    sink.write("{\"path\":\"");
+    write_json_escaped(sink, directory_path);
+    write_json_escaped(sink, name);
+    sink.write("\"");
+}
+
+void NdjsonEmitter::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool,
+    const EntryMetadata* metadata
+) {
+    if (is_directory)
+        last_directory.assign(name);
+    // The root path is shown as given, minus trailing slashes
+    if (depth == 0) {
+        while (name.size() > 1 && name.back() == '/')
+            name.remove_suffix(1);
+    }
+    write_path(name);
+    sink.write(",\"depth\":");
+    write_json_number(sink, depth);
+    sink.write(",\"type\":");
+    sink.write(json_type(is_directory));
+    write_json_metadata(sink, metadata, owners);
+    sink.write_line("}");
+}
+
+void NdjsonEmitter::write_link(
+    string_view name,
+    string_view target,
+    unsigned int depth,
+    bool,
+    const EntryMetadata* metadata
+) {
+    write_path(name);
+    sink.write(",\"depth\":");
+    write_json_number(sink, depth);
+    sink.write(",\"type\":\"link\",\"target\":");
+    write_json_string(sink, target);
+    write_json_metadata(sink, metadata, owners);
+    sink.write_line("}");
+}
+
+void NdjsonEmitter::begin_entries(unsigned int) {
+    path_lengths.push_back(directory_path.size());
+    directory_path += last_directory;
+    if (directory_path.empty() || directory_path.back() != '/')
+        directory_path += '/';
+}
+
+void NdjsonEmitter::end_entries() {
+    directory_path.resize(path_lengths.back());
+    path_lengths.pop_back();
+}
+
+void NdjsonEmitter::write_omitted(size_t omitted_count, unsigned int depth) {
+    // The record names the directory whose entries were cut off
+    string_view directory(directory_path);
+    if (directory.size() > 1) directory.remove_suffix(1);
+    sink.write("{\"path\":");
+    write_json_string(sink, directory);
+    sink.write(",\"depth\":");
+    write_json_number(sink, depth);
+    sink.write(",\"type\":\"omitted\",\"count\":");
+    write_json_number(sink, omitted_count);
+    sink.write_line("}");
+}
+
+void NdjsonEmitter::write_summary(unsigned int directory_count, unsigned int file_count) {
+    sink.write("{\"type\":\"report\",\"directories\":");
+    write_json_number(sink, directory_count);
+    sink.write(",\"files\":");
+    write_json_number(sink, file_count);
+    sink.write_line("}");
+}
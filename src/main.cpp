@@ -1,347 +1,38 @@
 #include "../include/argparse.hpp"
+#include "../include/binary_format.hpp"
+#include "../include/hierarchy.hpp"
+#include "../include/output_buffer.hpp"
+#include "../include/parallel_walker.hpp"
+#include "../include/pruned_walker.hpp"
+#include "../include/streaming_walker.hpp"
+#include "../include/tree_diff.hpp"
+#include "../include/tree_server.hpp"
+#include "../include/uring_walker.hpp"
+#include "../include/watch.hpp"
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <map>
+#include <thread>
 
-using std::map;
 using std::cerr;
 using std::cout;
 using std::endl;
-using std::stoul;
 using std::vector;
 using std::string;
-using std::wstring;
 
 namespace fs = std::filesystem;
 
-/**
- * @enum LevelState
- * @brief Represents the iteration state of a directory level.
- */
-enum LevelState {
-    NOT_ITERATING, ///< Indicates the last entry at the current level.
-    ITERATING,     ///< Indicates there are more entries to process at the current level.
-    NO_VALUE       ///< Indicates no specific state (used for the root level).
-};
-
-// Maps each directory depth level to its current iteration state.
-map<int, LevelState> level_states;
-
-// Other variables
-unsigned int directory_count = 0;
-unsigned int file_count = 0;
-
-// Function Declarations
-unsigned int get_directory_entry_count(const string& directory_path);
-void process_directory_entries(
-    const string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth,
-    unsigned int entry_count,
-    bool sort_entries = true,
-    const vector<string>& ignore_list = {}
-);
-void generate_directory_hierarchy(
-    string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth = 0,
-    bool sort_entries = true,
-    const vector<string>& ignore_list = {}
-);
-bool path_is_valid(
-    const string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth
-);
-string generate_hierarchy_format_string(LevelState state);
-string generate_character_string(unsigned int n, string s);
-string generate_x_padding_string(unsigned int depth, unsigned int x_spacing);
-string generate_entry_string(
-    const string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth
-);
-
-/**
- * @brief Generates the hierarchy format string based on the level state.
- *
- * @param state The current state of the directory level.
- * @return A string representing the hierarchy symbol.
- */
-string generate_hierarchy_format_string(LevelState state) {
-	switch (state) {
-		case ITERATING:
-			return "├";
-		case NOT_ITERATING:
-			return "└";
-		case NO_VALUE:
-			return "";
-	}
-	return "";
-}
-
-/**
- * @brief Generates a repeated character string.
- *
- * @param n The number of times to repeat the string.
- * @param s The string to repeat.
- * @return The concatenated string.
- */
-string generate_character_string(unsigned int n, string s) {
-	string result;
-	result.reserve(n * s.length());
-	for (unsigned int i = 0; i < n; ++i)
-		result += s;
-	return result;
-}
-
-/**
- * @brief Generates the padding string on the x-axis based on depth and 
- * spacing.
- *
- * @param depth The current depth in the directory hierarchy.
- * @param x_spacing The number of spaces for horizontal padding.
- * @return The padding string.
- */
-string generate_x_padding_string(unsigned int depth, unsigned int x_spacing) {
-	// Generate padding string
-	string padding_string = ""; 
-	for (unsigned int level = 1; level < depth; level++) {
-		// Retrieve state of each level
-		auto it = level_states.find(level);
-		if (it == level_states.end()) { // Level doesn't exist
-			cerr << "Level " << level << " doesn't exist!" << endl;
-			exit(1);
-		}
-		LevelState level_state = level_states[level];
-		// Append vertical line or space based on level state
-		padding_string += (level_state == ITERATING ? "│" : " ") 
-			+ string(x_spacing, ' ');
-	}
-	return padding_string;
-}
-
-/**
- * @brief Constructs the string representation of a directory or file entry.
- *
- * @param path The name of the directory or file.
- * @param x_spacing The number of spaces for horizontal padding.
- * @param y_spacing The number of lines for vertical padding.
- * @param depth The current depth in the directory hierarchy.
- * @return The formatted entry string.
- */
-string generate_entry_string(
-	const string& path,
-	unsigned int x_spacing,
-	unsigned int y_spacing,
-	unsigned int depth
-) {
-    if (level_states[depth] == NO_VALUE)
-        return path;
-    // Generate vertical padding
-    string y_padding_string = "";
-    for (unsigned int y = 0; y < y_spacing; y++) {
-        if (depth > 0 || y > 0) // Avoid leading newline for the first entry
-            y_padding_string += generate_x_padding_string(depth, x_spacing) + "│\n";
-    }
-    // Generate horizontal padding and hierarchy symbols
-    string x_padding_string = generate_x_padding_string(depth, x_spacing);    
-    x_padding_string += generate_hierarchy_format_string(level_states[depth]);
-    x_padding_string += generate_character_string(x_spacing, "─");
-    // Combine padding with the entry name
-    return y_padding_string + x_padding_string + path;
-}
-
-/**
- * @brief Retrieves the total number of entries within a directory.
- *
- * @param directory_path The path to the directory.
- * @return The count of directory entries.
- */
-unsigned int get_directory_entry_count(string& directory_path) {
-    unsigned int count = 0;
-    for (const auto& entry : fs::directory_iterator(directory_path))
-        count++;
-    return count; 
-}
-
-/**
- * @brief Validates the given path and handles it if it's a file or invalid.
- *
- * If the path is a file, it increments the file count, prints the file, and returns false
- * to indicate further processing should stop. If the path is invalid, it logs an error and
- * also returns false. If the path is a valid directory, it returns true to allow further processing.
- *
- * @param path The path to validate.
- * @param x_spacing The number of spaces for horizontal padding.
- * @param y_spacing The number of lines for vertical padding.
- * @param depth The current depth in the directory hierarchy.
- * @return true if the path is a valid directory, false otherwise.
- */
-bool path_is_valid(
-    const string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth
-) {
-    if (path.empty()) { 
-        cerr << "Error: Path is empty!" << endl;
-        return false;
-    }
-    // Check if the path is a file
-    if (fs::is_regular_file(path)) {
-        // Increment file count
-        file_count++;
-        // Print the file as a single entry
-        string entry_string = generate_entry_string(
-            path, x_spacing, y_spacing, depth
-        );
-        cout << entry_string << endl;
-        return false; // Path is a file
-    }
-    // Check if the path is a directory
-    if (!fs::is_directory(path)) {
-        cerr << "Error: Path is neither a file nor a directory!" << endl;
-        return false; // Invalid path
-    }
-    return true; // Path is a valid directory
-}
-
-/**
- * @brief Processes the entries in a directory and updates the hierarchy.
- *
- * @param path The current directory path.
- * @param x_spacing The number of spaces for horizontal padding.
- * @param y_spacing The number of lines for vertical padding.
- * @param depth The current depth in the directory hierarchy.
- * @param entry_count The total number of entries in the directory.
- * @param sort_entries Whether to sort directory entries before processing.
- * @param ignore_list List of file or directory names to ignore.
- */
-void process_directory_entries(
-    const string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth,
-    unsigned int entry_count,
-    bool sort_entries,
-    const vector<string>& ignore_list
-) {
-    // Collect all directory entries
-    vector<fs::directory_entry> entries;
-    for (const auto& entry : fs::directory_iterator(path)) {
-        // Skip ignored names
-        string name = entry.path().filename().string();
-        auto it = std::find(ignore_list.begin(), ignore_list.end(), name);
-        if (it != ignore_list.end()) continue;
-        entries.push_back(entry);
-    }
-    // Sort entries if the flag is enabled
-    if (sort_entries) {
-        std::sort(entries.begin(), entries.end(), 
-            [](const fs::directory_entry& a, const fs::directory_entry& b) {
-                string filename_a = a.path().filename().string();
-                string filename_b = b.path().filename().string();
-                return filename_a < filename_b;
-            }
-        );
-    }
-    // Process entries
-    int entry_index = 0;
-    for (const auto& entry : entries) {
-        entry_index++;
-        // Update the level state based on entry position
-        level_states[depth] = (entry_index != entry_count) 
-            ? ITERATING
-            : NOT_ITERATING;
-        if (fs::is_regular_file(entry)) {
-            // Increment file count
-            file_count++;
-            // Handle regular file
-            string filename = entry.path().filename().string();
-            string entry_string = generate_entry_string(
-                filename, x_spacing, y_spacing, depth
-            );
-            cout << entry_string << endl;
-        } else if (fs::is_directory(entry)) {
-            // Increment directory count
-            directory_count++;
-            // Handle subdirectory recursively
-            string entry_path = entry.path().string();
-            generate_directory_hierarchy(
-                entry_path, x_spacing, y_spacing, depth, sort_entries
-            );
-        }
-    }
-}
-
-/**
- * @brief Recursively generates and prints the directory hierarchy.
- *
- * @param path The current directory path.
- * @param x_spacing The number of spaces for horizontal padding.
- * @param y_spacing The number of lines for vertical padding.
- * @param depth The current depth in the directory hierarchy.
- * @param sort_entries Whether to sort directory entries.
- * @param ignore_list List of file or directory names to ignore.
- */
-void generate_directory_hierarchy(
-    string& path,
-    unsigned int x_spacing,
-    unsigned int y_spacing,
-    unsigned int depth,
-    bool sort_entries,
-    const vector<string>& ignore_list
-) {
-    // Validate the path
-    if (!path_is_valid(path, x_spacing, y_spacing, depth)) return;
-    // Ensure path ends with '/'
-    if (path.back() != '/') 
-        path += "/";
-    // Determine the display name based on the level state
-    string path_name = "";
-    switch (level_states[depth]) {
-        case NO_VALUE:
-            path_name += path;
-            break;
-        default: // Extract the directory name from the path
-            fs::path fs_path = path;
-            path_name += fs_path.parent_path().filename().string();
-            break;
-    }
-    // Ensure display name ends with '/'
-    if (path_name.back() != '/')
-        path_name += "/";
-    // Create and print the entry string
-    string entry_string = generate_entry_string(
-        path_name, x_spacing, y_spacing, depth
-    );
-    cout << entry_string << endl;
-    // Increment depth for recursion
-    depth++;
-    // Get the number of entries in the current directory
-    unsigned int entry_count = get_directory_entry_count(path);
-    // Process entries
-    process_directory_entries(
-        path, x_spacing, y_spacing, 
-        depth, entry_count, sort_entries,
-        ignore_list
-    );
-}
-
 int main(int argc, char* argv[]) {
+    // Tree output goes through OutputBuffer; iostreams need no stdio sync
+    std::ios::sync_with_stdio(false);
     // Initialize argparse
     argparse::ArgumentParser program("lstree", "1.0");
     // Define arguments
     program.add_argument("directory_path")
-        .nargs(1)
+        .nargs(argparse::nargs_pattern::any)
         .default_value(vector<string>{"."})
-        .help("Path to the directory to visualize. Defaults to the current directory.");
+        .help("Paths of the directories to visualize, each printed as its own tree. With --threads, all are read at once on one pool unless --prune, --cache, --follow-links or -e uring is set. Defaults to the current directory.");
     program.add_argument("-x", "--x_spacing")
         .default_value(3)
         .scan<'i', int>() // Parse as integer
@@ -350,6 +41,9 @@ int main(int argc, char* argv[]) {
         .default_value(1)
         .scan<'i', int>() // Parse as integer
         .help("Vertical spacing (number of lines). Defaults to 1.");
+    program.add_argument("--charset")
+        .default_value(string("utf8"))
+        .help("Characters the tree is drawn with: 'utf8' or 'ascii'. Defaults to utf8.");
     program.add_argument("-s", "--sort")
         .default_value(true)
         .action([](const string& value) {
@@ -358,10 +52,102 @@ int main(int argc, char* argv[]) {
             throw std::runtime_error("Invalid value for --sort. Use 'true' or 'false'.");
         })
         .help("Enable or disable sorting of directory entries. Defaults to true.");
+    program.add_argument("--sort-chunk")
+        .default_value(1 << 20)
+        .scan<'i', int>() // Parse as integer
+        .help("Directories with more entries are sorted in chunks of this many and merged (0 = never). Defaults to 1048576.");
+    program.add_argument("--sort-memory")
+        .default_value(256)
+        .scan<'i', int>() // Parse as integer
+        .help("MiB of sorted chunks kept in memory per directory before they are spilled to a temporary file. Defaults to 256.");
     program.add_argument("-i", "--ignore")
         .default_value(vector<string>{})
         .append()
-        .help("List of file or directory names to ignore.");
+        .help("List of file or directory names (or wildcard patterns like '*.o') to ignore.");
+    program.add_argument("-P", "--match")
+        .default_value(vector<string>{})
+        .append()
+        .help("Only list files whose names match one of these names or wildcard patterns; directories are always listed.");
+    program.add_argument("--prune")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Leave out directories with no file listed below them, e.g. after --match.");
+    program.add_argument("-l", "--follow-links")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Descend into symlinked directories, entering each directory once. By default links are shown as 'name -> target'.");
+    program.add_argument("-g", "--gitignore")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Prune entries matched by .gitignore files and .git/info/exclude.");
+    program.add_argument("-L", "--max-depth")
+        .default_value(0)
+        .scan<'i', int>() // Parse as integer
+        .help("Deepest level whose entries are listed (0 = unlimited). Defaults to 0.");
+    program.add_argument("--max-entries-per-dir")
+        .default_value(0)
+        .scan<'i', int>() // Parse as integer
+        .help("Entries printed per directory before a '… (N more)' line (0 = unlimited). Defaults to 0.");
+    program.add_argument("--cache")
+        .default_value(string(""))
+        .help("Snapshot file replaying unchanged directories; updated after each run.");
+    program.add_argument("-w", "--watch")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Keep running and reprint the tree whenever it changes (Linux only).");
+    program.add_argument("--serve")
+        .default_value(string(""))
+        .help("Keep the tree of the directory in memory, current through inotify, and answer --client requests on this Unix socket, one at a time (Linux only).");
+    program.add_argument("--client")
+        .default_value(string(""))
+        .help("Ask the daemon on this Unix socket for the tree of a directory it serves instead of walking it.");
+    program.add_argument("--size")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Show the size in bytes of each entry.");
+    program.add_argument("-D", "--date")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Show the last modification time of each entry.");
+    program.add_argument("-u", "--owner")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Show the owner of each entry.");
+    program.add_argument("--du")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Show each directory with the total size of its subtree; hard links count once.");
+    program.add_argument("--top")
+        .default_value(0)
+        .scan<'i', int>() // Parse as integer
+        .help("Print only the N files ranked first by --by instead of the tree (0 = off).");
+    program.add_argument("--by")
+        .default_value(string("size"))
+        .help("What --top ranks files by: 'size' (largest) or 'mtime' (newest). Defaults to size.");
+    program.add_argument("-f", "--format")
+        .default_value(string("text"))
+        .help("Output format: 'text', 'json' (nested, like tree -J), 'ndjson' (one record per entry) or 'bin' (compact dump). Defaults to text.");
+    program.add_argument("--from")
+        .default_value(string(""))
+        .help("Print a dump written by --format bin instead of walking a directory.");
+    program.add_argument("--diff")
+        .nargs(2)
+        .default_value(vector<string>{})
+        .help("Print only what was added, removed or changed from the first to the second directory or --format bin dump.");
+    program.add_argument("--stats")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Print timings, syscall counts and the slowest directories to stderr.");
+    program.add_argument("-t", "--threads")
+        .default_value(1)
+        .scan<'i', int>() // Parse as integer
+        .help("Number of worker threads reading directories (0 = all cores); ignored with --prune, --cache, --follow-links, and -e uring where io_uring is available. Defaults to 1.");
+    program.add_argument("-b", "--backend")
+        .default_value(string("std"))
+        .help("Directory reading backend: 'std' or 'getdents' (Linux only). Defaults to std.");
+    program.add_argument("-e", "--engine")
+        .default_value(string("sync"))
+        .help("Traversal engine: 'sync' or 'uring' (io_uring opens and statx batches, Linux only; falls back to sync). Defaults to sync.");
     // Parse arguments
     try {
         program.parse_args(argc, argv);
@@ -371,37 +157,274 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     // Retrieve parsed values
-    string directory_path = program.get<vector<string>>("directory_path")[0];
-    int x_spacing = program.get<int>("--x_spacing");
-    int y_spacing = program.get<int>("--y_spacing");
-    bool sort_entries = program.get<bool>("--sort");
-    vector<string> ignore_list = program.get<vector<string>>("--ignore");
+    vector<string> directory_paths = program.get<vector<string>>("directory_path");
+    HierarchyOptions options;
+    options.x_spacing = program.get<int>("--x_spacing");
+    options.y_spacing = program.get<int>("--y_spacing");
+    string charset = program.get<string>("--charset");
+    if (charset == "ascii") {
+        options.charset = Charset::ASCII;
+    } else if (charset != "utf8") {
+        cerr << "Error: Unsupported --charset '" << charset << "'." << endl;
+        return 1;
+    }
+    options.sort_entries = program.get<bool>("--sort");
+    int sort_chunk = program.get<int>("--sort-chunk");
+    int sort_memory = program.get<int>("--sort-memory");
+    if (sort_chunk < 0 || sort_memory < 0) {
+        cerr << "Error: --sort-chunk and --sort-memory must not be negative." << endl;
+        return 1;
+    }
+    options.sort_chunk_entries = sort_chunk;
+    options.sort_memory = static_cast<size_t>(sort_memory) << 20;
+    options.ignore = IgnoreMatcher(program.get<vector<string>>("--ignore"));
+    options.match = IgnoreMatcher(program.get<vector<string>>("--match"));
+    options.use_gitignore = program.get<bool>("--gitignore");
+    options.follow_links = program.get<bool>("--follow-links");
+    string backend = program.get<string>("--backend");
+    if (backend == "getdents" && getdents_backend_available()) {
+        options.backend = ReadBackend::GETDENTS;
+    } else if (backend != "std") {
+        cerr << "Error: Unsupported --backend '" << backend << "' on this platform." << endl;
+        return 1;
+    }
+    string engine = program.get<string>("--engine");
+    if (engine != "sync" && engine != "uring") {
+        cerr << "Error: Unsupported --engine '" << engine << "'." << endl;
+        return 1;
+    }
+    options.batch_metadata = engine == "uring";
+    int max_depth = program.get<int>("--max-depth");
+    int max_entries = program.get<int>("--max-entries-per-dir");
+    if (max_depth < 0 || max_entries < 0) {
+        cerr << "Error: --max-depth and --max-entries-per-dir must not be negative." << endl;
+        return 1;
+    }
+    options.max_depth = max_depth;
+    options.max_entries_per_directory = max_entries;
+    int thread_count = program.get<int>("--threads");
+    if (thread_count < 0) {
+        cerr << "Error: --threads must not be negative." << endl;
+        return 1;
+    }
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
 
-    // TODO: Convert to class initializer
-    // Initialize root level state
-    level_states[0] = NO_VALUE;
-    // Check if input path is a file
-    if (fs::is_regular_file(directory_path)) {
-        file_count = 1;
-        generate_directory_hierarchy(directory_path, x_spacing, y_spacing, 0, sort_entries);
-        cout << "\n0 directories, 1 file\n";
+    string format_name = program.get<string>("--format");
+    OutputFormat format;
+    if (format_name == "text") {
+        format = OutputFormat::TEXT;
+    } else if (format_name == "json") {
+        format = OutputFormat::JSON;
+    } else if (format_name == "ndjson") {
+        format = OutputFormat::NDJSON;
+    } else if (format_name == "bin") {
+        format = OutputFormat::BINARY;
+    } else {
+        cerr << "Error: Unsupported --format '" << format_name << "'." << endl;
+        return 1;
+    }
+
+    if (program.get<bool>("--size")) options.columns |= METADATA_SIZE;
+    if (program.get<bool>("--date")) options.columns |= METADATA_MTIME;
+    if (program.get<bool>("--owner")) options.columns |= METADATA_OWNER;
+    options.disk_usage = program.get<bool>("--du");
+    if (options.disk_usage) options.columns |= METADATA_SIZE;
+    int top_entries = program.get<int>("--top");
+    string top_order = program.get<string>("--by");
+    if (top_entries < 0) {
+        cerr << "Error: --top must not be negative." << endl;
+        return 1;
+    }
+    if (top_order != "size" && top_order != "mtime") {
+        cerr << "Error: Unsupported --by '" << top_order << "'." << endl;
+        return 1;
+    }
+    if (top_entries > 0 && options.disk_usage) {
+        cerr << "Error: --top and --du cannot be combined." << endl;
+        return 1;
+    }
+    // Totals need every entry, and capped ones are never read
+    if (options.disk_usage && options.max_entries_per_directory) {
+        cerr << "Error: --du and --max-entries-per-dir cannot be combined." << endl;
+        return 1;
+    }
+    options.top_entries = top_entries;
+    options.top_field = (top_order == "size") ? METADATA_SIZE : METADATA_MTIME;
+    if (options.top_entries) options.columns |= options.top_field;
+
+    bool prune = program.get<bool>("--prune");
+    if (prune && program.get<bool>("--watch")) {
+        cerr << "Error: --prune cannot be combined with --watch." << endl;
+        return 1;
+    }
+    if (options.follow_links && program.get<bool>("--watch")) {
+        cerr << "Error: --follow-links cannot be combined with --watch." << endl;
+        return 1;
+    }
+
+    vector<string> diff_paths = program.get<vector<string>>("--diff");
+    if (!diff_paths.empty()) {
+        if (format != OutputFormat::TEXT || options.disk_usage || options.top_entries || prune
+            || program.get<bool>("--watch") || !program.get<string>("--cache").empty()
+            || !program.get<string>("--from").empty()) {
+            cerr << "Error: --diff only supports the text format and cannot be combined with "
+                "--du, --top, --prune, --watch, --cache or --from." << endl;
+            return 1;
+        }
+    }
+
+    string serve_socket = program.get<string>("--serve");
+    string client_socket = program.get<string>("--client");
+    if (!serve_socket.empty() || !client_socket.empty()) {
+        if (!serve_socket.empty() && !client_socket.empty()) {
+            cerr << "Error: --serve and --client cannot be combined." << endl;
+            return 1;
+        }
+        if (options.disk_usage || options.top_entries || prune || options.follow_links
+            || !diff_paths.empty() || program.get<bool>("--watch") || program.get<bool>("--stats")
+            || !program.get<string>("--cache").empty() || !program.get<string>("--from").empty()) {
+            cerr << "Error: --serve and --client cannot be combined with --du, --top, --prune, "
+                "--follow-links, --diff, --watch, --stats, --cache or --from." << endl;
+            return 1;
+        }
+        if (directory_paths.size() != 1) {
+            cerr << "Error: --serve and --client need a single directory." << endl;
+            return 1;
+        }
+    }
+    if (!serve_socket.empty()) {
+        // Listings carry every column a request can ask for
+        options.metadata_fields = METADATA_SIZE | METADATA_MTIME | METADATA_OWNER;
+        return serve_directory_hierarchy(serve_socket, directory_paths[0], options);
+    }
+    if (!client_socket.empty()) {
+        if (!options.ignore.empty() || !options.match.empty() || options.use_gitignore
+            || !options.sort_entries || options.max_entries_per_directory) {
+            cerr << "Error: --ignore, --match, --gitignore, --sort and --max-entries-per-dir "
+                "are set when the daemon starts." << endl;
+            return 1;
+        }
+        TreeRequest request;
+        std::error_code error;
+        fs::path resolved = fs::canonical(directory_paths[0], error);
+        request.path = (error ? fs::absolute(directory_paths[0]).lexically_normal() : resolved).string();
+        request.name = directory_paths[0];
+        request.format = format;
+        request.columns = options.columns;
+        request.max_depth = options.max_depth;
+        request.x_spacing = options.x_spacing;
+        request.y_spacing = options.y_spacing;
+        request.charset = options.charset;
+        OutputBuffer output;
+        return request_directory_hierarchy(client_socket, request, output);
+    }
+
+    RunStats stats;
+    if (program.get<bool>("--stats")) {
+        if (program.get<bool>("--watch")) {
+            cerr << "Error: --stats cannot be combined with --watch." << endl;
+            return 1;
+        }
+        options.stats = &stats;
+        stats.start();
+    }
+
+    OutputBuffer output;
+    std::unique_ptr<TreeEmitter> emitter = make_tree_emitter(format, output, options);
+    // Entries are only stat'ed for the fields the emitter shows
+    options.metadata_fields = emitter->metadata_fields();
+    HierarchyState state(*emitter);
+    if (!diff_paths.empty()) {
+        // Sizes are always compared, modification times with --date
+        DirectoryTree before, after;
+        if (!load_diff_tree(diff_paths[0], options, thread_count, before)
+            || !load_diff_tree(diff_paths[1], options, thread_count, after))
+            return 1;
+        unsigned int compared_fields = METADATA_SIZE | (options.columns & METADATA_MTIME);
+        TreeDiffCounts counts = emit_tree_diff(before, after, compared_fields, *emitter);
+        write_diff_summary(counts, output);
+        if (options.stats) {
+            output.flush();
+            stats.report(cerr);
+        }
         return 0;
     }
-    // If input is a directory, include root directory in the count
-    if (fs::is_directory(directory_path)) {
-        directory_count = 1; // Count the root directory
+    // Replay a dump through the chosen emitter
+    string dump_path = program.get<string>("--from");
+    if (!dump_path.empty())
+        return render_binary_tree(dump_path, *emitter) ? 0 : 1;
+    // Directory roots count as directories, like the ones below them
+    for (const string& directory_path : directory_paths) {
+        if (fs::is_directory(directory_path))
+            state.directory_count++;
+    }
+    if (program.get<bool>("--watch")) {
+        if (directory_paths.size() != 1 || !fs::is_directory(directory_paths[0])) {
+            cerr << "Error: --watch needs a single directory." << endl;
+            return 1;
+        }
+        return watch_directory_hierarchy(directory_paths[0], options, format, output);
+    }
+    string cache_path = program.get<string>("--cache");
+    if (!cache_path.empty() && !snapshot_cache_available()) {
+        cerr << "Error: --cache is not supported on this platform." << endl;
+        return 1;
+    }
+    std::unique_ptr<SnapshotCache> snapshot;
+    if (!cache_path.empty()) {
+        snapshot = std::make_unique<SnapshotCache>(cache_path);
+        state.snapshot = snapshot.get();
     }
-    // Generate and print the directory hierarchy
-    generate_directory_hierarchy(
-        directory_path, 
-        x_spacing, y_spacing, 
-        0, sort_entries, ignore_list
-    );
+    // Generate and print the directory hierarchies in argument order
+    bool shared_pool = thread_count > 1 && !prune && !snapshot && !options.follow_links
+        && engine != "uring";
+    try {
+        if (shared_pool) {
+            // All roots are read at once by the same workers
+            generate_directory_hierarchies_parallel(
+                directory_paths, options, state, thread_count
+            );
+        } else {
+            for (string& directory_path : directory_paths) {
+                // Every root gets its own cycle detection
+                state.visited_directories = InodeSet();
+                if (prune) {
+                    // Held-back directory lines need a single depth-first walk
+                    generate_directory_hierarchy_pruned(directory_path, options, state);
+                } else if (snapshot || options.follow_links) {
+                    // Replayed directories cost no reads, so the serial walker
+                    // suffices; it also keeps the set of directories entered
+                    generate_directory_hierarchy(directory_path, options, state);
+                } else if (engine == "uring"
+                    && generate_directory_hierarchy_uring(directory_path, options, state)) {
+                    // Done; without io_uring the synchronous walkers below run instead
+                } else if (thread_count > 1) {
+                    generate_directory_hierarchy_parallel(
+                        directory_path, options, state, thread_count
+                    );
+                } else if (!options.sort_entries) {
+                    // Nothing to sort, so print entries while they are read
+                    generate_directory_hierarchy_streaming(directory_path, options, state);
+                } else {
+                    generate_directory_hierarchy(directory_path, options, state);
+                }
+            }
+        }
+    } catch (const fs::filesystem_error& err) {
+        // Keep everything printed so far, then report the failure
+        output.flush();
+        cerr << "Error: " << err.what() << endl;
+        return 1;
+    }
+    if (snapshot && !snapshot->save())
+        cerr << "Warning: could not update the snapshot " << cache_path << endl;
     // Print summary
-    cout << "\n" << directory_count 
-         << (directory_count == 1 ? " directory, " : " directories, ")
-         << file_count 
-         << (file_count == 1 ? " file\n" : " files\n");
+    print_summary(state);
+    if (options.stats) {
+        output.flush();
+        stats.report(cerr);
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include "../include/metadata_reader.hpp"
+#include "../include/io_uring_queue.hpp"
+#include "../include/run_stats.hpp"
+#include <chrono>
+#include <filesystem>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace fs = std::filesystem;
+
+// Listings at least this long have their metadata read through io_uring, when batching.
+static constexpr size_t BATCH_THRESHOLD = 16;
+// Submission slots of each thread's statx queue.
+static constexpr unsigned int QUEUE_DEPTH = 128;
+
+string_view OwnerNames::lookup(uint32_t owner) {
+    auto cached = names.find(owner);
+    if (cached != names.end()) return cached->second;
+    string name = std::to_string(owner);
+#ifdef __linux__
+    passwd entry;
+    passwd* result = nullptr;
+    char buffer[1024];
+    if (getpwuid_r(owner, &entry, buffer, sizeof(buffer), &result) == 0 && result)
+        name = result->pw_name;
+#endif
+    return names.emplace(owner, std::move(name)).first->second;
+}
+
+#ifdef __linux__
+
+/**
+ * @brief The statx mask asking for exactly the selected fields.
+ */
+static unsigned int statx_mask(unsigned int fields) {
+    unsigned int mask = 0;
+    if (fields & METADATA_SIZE) mask |= STATX_SIZE;
+    if (fields & METADATA_MTIME) mask |= STATX_MTIME;
+    if (fields & METADATA_OWNER) mask |= STATX_UID;
+    if (fields & METADATA_IDENTITY) mask |= STATX_INO;
+    return mask;
+}
+
+/**
+ * @brief Copies the selected fields the kernel filled in.
+ */
+static void store_statx(const struct statx& status, unsigned int fields, EntryMetadata& metadata) {
+    metadata = EntryMetadata();
+    if ((fields & METADATA_SIZE) && (status.stx_mask & STATX_SIZE)) {
+        metadata.size = status.stx_size;
+        metadata.fields |= METADATA_SIZE;
+    }
+    if ((fields & METADATA_MTIME) && (status.stx_mask & STATX_MTIME)) {
+        metadata.mtime_ns = status.stx_mtime.tv_sec * 1000000000LL + status.stx_mtime.tv_nsec;
+        metadata.fields |= METADATA_MTIME;
+    }
+    if ((fields & METADATA_OWNER) && (status.stx_mask & STATX_UID)) {
+        metadata.owner = status.stx_uid;
+        metadata.fields |= METADATA_OWNER;
+    }
+    // The device is always filled in
+    if ((fields & METADATA_IDENTITY) && (status.stx_mask & STATX_INO)) {
+        metadata.device = makedev(status.stx_dev_major, status.stx_dev_minor);
+        metadata.inode = status.stx_ino;
+        metadata.fields |= METADATA_IDENTITY;
+    }
+}
+
+/**
+ * @brief The descriptor and path statx needs for an entry.
+ *
+ * The std::filesystem backend has no descriptor, so its entries are
+ * addressed by their full path, built into @p path.
+ */
+static int statx_target(
+    const OpenDirectory& directory,
+    string_view name,
+    string& path,
+    const char*& target
+) {
+    if (directory.fd >= 0) {
+        // Listing names are NUL-terminated, see NameArena::store()
+        target = name.data();
+        return directory.fd;
+    }
+    path = directory.path;
+    if (!path.empty() && path.back() != '/')
+        path += "/";
+    path += name;
+    target = path.c_str();
+    return AT_FDCWD;
+}
+
+/**
+ * @brief Reads the metadata of a listing with batches of IORING_OP_STATX.
+ *
+ * Every batch is waited for before the next one is queued, so the listing
+ * and the result buffers outlive all requests.
+ *
+ * @return false if the thread has no usable queue; nothing was read then.
+ */
+static bool read_listing_metadata_batched(
+    const OpenDirectory& directory,
+    DirectoryListing& listing,
+    unsigned int fields
+) {
+    static thread_local IoUring queue(QUEUE_DEPTH);
+    if (!queue.ready()) return false;
+    size_t count = listing.entries.size();
+    vector<struct statx> results(std::min<size_t>(count, queue.capacity()));
+    vector<string> paths(directory.fd >= 0 ? 0 : results.size());
+    unsigned int mask = statx_mask(fields);
+    for (size_t first = 0; first < count; first += results.size()) {
+        size_t batch = std::min(results.size(), count - first);
+        for (size_t i = 0; i < batch; i++) {
+            io_uring_sqe* request = queue.next_submission();
+            string unused;
+            const char* target;
+            int fd = statx_target(directory, listing.entries[first + i].name,
+                directory.fd >= 0 ? unused : paths[i], target);
+            request->opcode = IORING_OP_STATX;
+            request->fd = fd;
+            request->addr = reinterpret_cast<uint64_t>(target);
+            request->len = mask;
+            // Links shown as links describe themselves
+            request->statx_flags = listing.entries[first + i].is_link() ? AT_SYMLINK_NOFOLLOW : 0;
+            request->off = reinterpret_cast<uint64_t>(&results[i]);
+            request->user_data = i;
+        }
+        count_stat(STATS_STAT, batch);
+        if (!queue.submit_and_wait(batch)) {
+            // Nothing of this batch was queued; finish synchronously
+            for (size_t i = first; i < count; i++)
+                read_entry_metadata(directory, listing.entries[i].name, fields,
+                    listing.metadata[i], !listing.entries[i].is_link());
+            return true;
+        }
+        for (size_t completed = 0; completed < batch;) {
+            io_uring_cqe completion;
+            if (!queue.pop_completion(completion)) {
+                queue.submit_and_wait(batch - completed);
+                continue;
+            }
+            size_t i = completion.user_data;
+            if (completion.res == 0) {
+                store_statx(results[i], fields, listing.metadata[first + i]);
+            } else {
+                listing.metadata[first + i] = EntryMetadata();
+            }
+            completed++;
+        }
+    }
+    return true;
+}
+
+#endif
+
+/**
+ * @brief Reads the selected metadata fields of an entry.
+ *
+ * Uses statx with a mask of just the selected fields, so filesystems can
+ * skip the work for the others.
+ *
+ * @param directory The open directory containing the entry.
+ * @param name The entry name; must be NUL-terminated for the getdents backend.
+ * @param fields The MetadataField bits to read.
+ * @param metadata Receives the fields; its fields mask says which were read.
+ * @param follow_link Whether a symlink describes its target rather than itself.
+ * @return false if the entry could not be stat'ed.
+ */
+bool read_entry_metadata(
+    const OpenDirectory& directory,
+    string_view name,
+    unsigned int fields,
+    EntryMetadata& metadata,
+    bool follow_link
+) {
+    metadata = EntryMetadata();
+    count_stat(STATS_STAT);
+#ifdef __linux__
+    string path;
+    const char* target;
+    int fd = statx_target(directory, name, path, target);
+    struct statx status;
+    int flags = follow_link ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (statx(fd, target, flags, statx_mask(fields), &status) != 0) return false;
+    store_statx(status, fields, metadata);
+    return true;
+#else
+    std::error_code error;
+    fs::path path = fs::path(directory.path) / name;
+    // std::filesystem has no times or sizes of links themselves
+    if (!follow_link) return false;
+    if (fields & METADATA_MTIME) {
+        auto modified = fs::last_write_time(path, error);
+        if (error) return false;
+        auto since_epoch = std::chrono::file_clock::to_sys(modified).time_since_epoch();
+        metadata.mtime_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+        metadata.fields |= METADATA_MTIME;
+    }
+    if ((fields & METADATA_SIZE) && fs::is_regular_file(path, error)) {
+        metadata.size = fs::file_size(path, error);
+        metadata.fields |= METADATA_SIZE;
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Reads the selected metadata fields of every entry of a listing.
+ *
+ * Each entry costs one statx. With @p batched, long listings are read
+ * through a per-thread io_uring queue instead, so the stats of one
+ * directory overlap; that pays off where statx blocks, on cold or network
+ * filesystems, but on a warm cache the kernel hands each request to a
+ * worker thread and direct calls are faster.
+ *
+ * @param directory The open directory the listing was read from.
+ * @param listing The listing; its metadata vector is filled, one per entry.
+ * @param fields The MetadataField bits to read.
+ * @param batched Whether long listings go through io_uring, where available.
+ */
+void read_listing_metadata(
+    const OpenDirectory& directory,
+    DirectoryListing& listing,
+    unsigned int fields,
+    bool batched
+) {
+    listing.metadata.assign(listing.entries.size(), EntryMetadata());
+#ifdef __linux__
+    if (batched && listing.entries.size() >= BATCH_THRESHOLD
+        && read_listing_metadata_batched(directory, listing, fields))
+        return;
+#endif
+    for (size_t i = 0; i < listing.entries.size(); i++)
+        read_entry_metadata(directory, listing.entries[i].name, fields,
+            listing.metadata[i], !listing.entries[i].is_link());
+}
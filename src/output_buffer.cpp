@@ -0,0 +1,70 @@
+#include "../include/output_buffer.hpp"
+#include "../include/run_stats.hpp"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using std::string_view;
+
+/**
+ * @brief Creates a buffer for a descriptor.
+ *
+ * @param fd The descriptor to write to. Defaults to standard output.
+ * @param capacity The buffer size in bytes.
+ */
+OutputBuffer::OutputBuffer(int fd, size_t capacity)
+    : fd(fd),
+      buffer(std::make_unique<char[]>(capacity)),
+      capacity(capacity),
+      interactive(isatty(fd) == 1) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::write(string_view text) {
+    if (text.size() > capacity - used) {
+        flush();
+        // Text larger than the whole buffer bypasses it
+        if (text.size() > capacity) {
+            write_all(text.data(), text.size());
+            return;
+        }
+    }
+    std::memcpy(buffer.get() + used, text.data(), text.size());
+    used += text.size();
+}
+
+void OutputBuffer::write_line(string_view text) {
+    write(text);
+    write("\n");
+    if (interactive) flush();
+}
+
+void OutputBuffer::flush() {
+    if (used == 0) return;
+    write_all(buffer.get(), used);
+    used = 0;
+}
+
+/**
+ * @brief Writes a block completely, retrying short and interrupted writes.
+ *
+ * After a write error the remaining output is dropped, like a failed
+ * std::ostream would.
+ */
+void OutputBuffer::write_all(const char* data, size_t size) {
+    PhaseTimer timer(PHASE_OUTPUT);
+    while (size > 0 && !failed) {
+        ssize_t written = ::write(fd, data, size);
+        count_stat(STATS_WRITE);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            failed = true;
+            return;
+        }
+        count_stat(STATS_BYTES_WRITTEN, written);
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
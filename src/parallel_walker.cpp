@@ -0,0 +1,143 @@
+#include "../include/parallel_walker.hpp"
+#include "../include/directory_task.hpp"
+#include "../include/work_stealing_pool.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <semaphore>
+
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace {
+
+/**
+ * @enum TaskStatus
+ * @brief Lifecycle of a directory read.
+ */
+enum TaskStatus {
+    QUEUED,  ///< Waiting in a worker deque.
+    RUNNING, ///< Claimed by a worker or by the sequencer.
+    DONE     ///< Listing (or error) is available.
+};
+
+/**
+ * @brief How many directories may be read at once, out of open_directory_limit().
+ *
+ * Every read holds a descriptor; the rest of the limit goes to the
+ * directories kept open for their subdirectory tasks.
+ */
+size_t read_limit(unsigned int thread_count) {
+    // The printer reads inline as well
+    return std::clamp<size_t>(open_directory_limit() / 2, 1, size_t(thread_count) + 1);
+}
+
+/**
+ * @class ParallelWalker
+ * @brief Reads directories on a work-stealing pool and prints them in order.
+ *
+ * Workers read ahead of the printer only as far as open_directory_limit()
+ * allows: reads wait for one of read_limit() slots, and directories past
+ * the DescriptorBudget are detached rather than kept open.
+ */
+class ParallelWalker {
+public:
+    ParallelWalker(
+        const HierarchyOptions& options,
+        HierarchyState& state,
+        unsigned int thread_count
+    ) : options(options), state(state),
+        reads(static_cast<std::ptrdiff_t>(read_limit(thread_count))),
+        budget(std::make_shared<DescriptorBudget>(
+            open_directory_limit() - read_limit(thread_count)
+        )),
+        pool(thread_count) {}
+
+    /**
+     * @brief Prints the entries of a task's subtree, waiting for reads as needed.
+     */
+    void render(const shared_ptr<DirectoryTask>& root, unsigned int depth) {
+        render_directory_task(root, depth, options, state,
+            [this](DirectoryTask& task) { wait_for(task); });
+    }
+
+    void schedule(const shared_ptr<DirectoryTask>& task) {
+        pool.submit([this, task] { run(*task); });
+    }
+
+private:
+    /**
+     * @brief Reads a directory unless another thread already claimed it.
+     */
+    void run(DirectoryTask& task) {
+        int expected = QUEUED;
+        if (!task.status.compare_exchange_strong(expected, RUNNING)) return;
+        reads.acquire();
+        read_directory_task(task, options, [this](const DirectoryTask& subdirectory) {
+            return open_subdirectory(
+                *subdirectory.parent_directory, subdirectory.name, options.backend
+            );
+        }, budget);
+        reads.release();
+        // Queue in reverse so this worker pops the first subdirectory next
+        for (auto it = task.subdirectories.rbegin(); it != task.subdirectories.rend(); ++it)
+            schedule(*it);
+        task.status.store(DONE, std::memory_order_release);
+        task.status.notify_all();
+    }
+
+    /**
+     * @brief Blocks until a task is done, reading it inline if still queued.
+     */
+    void wait_for(DirectoryTask& task) {
+        run(task);
+        int status;
+        while ((status = task.status.load(std::memory_order_acquire)) != DONE)
+            task.status.wait(status, std::memory_order_acquire);
+    }
+
+    const HierarchyOptions& options;
+    HierarchyState& state;
+    std::counting_semaphore<> reads;
+    std::shared_ptr<DescriptorBudget> budget;
+    WorkStealingPool pool; ///< Last, so the workers are joined first.
+};
+
+}
+
+void generate_directory_hierarchy_parallel(
+    string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int thread_count
+) {
+    vector<string> paths{path};
+    generate_directory_hierarchies_parallel(paths, options, state, thread_count);
+}
+
+void generate_directory_hierarchies_parallel(
+    const vector<string>& paths,
+    const HierarchyOptions& options,
+    HierarchyState& state,
+    unsigned int thread_count
+) {
+    ParallelWalker walker(options, state, thread_count);
+    vector<shared_ptr<DirectoryTask>> roots(paths.size());
+    // Queue in reverse so that the workers pop the first roots first
+    for (size_t i = paths.size(); i-- > 0;) {
+        if (paths[i].empty() || !std::filesystem::is_directory(paths[i])) continue;
+        roots[i] = make_shared<DirectoryTask>(paths[i], nullptr, 0);
+        walker.schedule(roots[i]);
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (!roots[i]) {
+            path_is_valid(paths[i], state, 0);
+            continue;
+        }
+        print_directory_header(paths[i], state, 0);
+        walker.render(roots[i], 0);
+        roots[i].reset();
+    }
+}
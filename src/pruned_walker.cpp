@@ -0,0 +1,362 @@
+#include "../include/pruned_walker.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace {
+
+/**
+ * @struct PrunedLevel
+ * @brief A directory on the path being walked.
+ */
+struct PrunedLevel {
+    OpenDirectory directory;
+    shared_ptr<const GitignoreScope> gitignore;
+    DirectoryListing listing;
+    vector<int8_t> shown; ///< Per entry: 1 printed, 0 pruned, -1 not probed yet.
+    size_t index = 0;     ///< The entry being walked.
+    bool written = false; ///< Whether the directory's line and begin_entries() went out.
+    bool released = false; ///< Whether the descriptor is closed until the walk returns here.
+};
+
+/**
+ * @struct ProbeFrame
+ * @brief A directory a probe is looking through.
+ */
+struct ProbeFrame {
+    OpenDirectory directory;
+    shared_ptr<const GitignoreScope> gitignore;
+    DirectoryListing listing;
+    size_t index = 0; ///< The next subdirectory to look into.
+    bool released = false; ///< Whether the descriptor is closed until the probe returns here.
+    bool identified = false; ///< Whether device and inode are known.
+    bool cut_short = false;  ///< Whether a link cycle was skipped below, with --follow-links.
+    uint64_t device = 0;
+    uint64_t inode = 0;
+};
+
+/**
+ * @brief What a probe learns on reaching a directory.
+ */
+enum class ProbeStart {
+    EMPTY,     ///< No file below it, or skipped.
+    CYCLE,     ///< Already on the probe's path, through a link.
+    HAS_FILES, ///< A file is listed in it or below it.
+    DESCEND,   ///< Only subdirectories are listed; they have to be probed.
+};
+
+/**
+ * @class PrunedWalker
+ * @brief Walks a tree depth-first, writing directory lines only when needed.
+ */
+class PrunedWalker {
+public:
+    PrunedWalker(const HierarchyOptions& options, HierarchyState& state)
+        : options(options), probe_options(options), state(state),
+          open_limit(open_directory_limit()) {
+        // Probes only look for a file; order, limits and columns do not matter
+        probe_options.sort_entries = false;
+        probe_options.max_entries_per_directory = 0;
+        probe_options.metadata_fields = 0;
+    }
+
+    void walk_root(OpenDirectory directory, shared_ptr<const GitignoreScope> gitignore);
+
+private:
+    void start_level(
+        PrunedLevel& level,
+        OpenDirectory directory,
+        shared_ptr<const GitignoreScope> gitignore
+    );
+    bool entry_is_shown(PrunedLevel& level, size_t index);
+    bool later_entry_is_shown(PrunedLevel& level);
+    bool subtree_has_files(OpenDirectory directory, shared_ptr<const GitignoreScope> gitignore);
+    ProbeStart start_probe_frame(
+        ProbeFrame& frame,
+        OpenDirectory directory,
+        shared_ptr<const GitignoreScope> gitignore,
+        InodeSet& probed
+    );
+    void write_pending_lines();
+
+    const HierarchyOptions& options;
+    HierarchyOptions probe_options;
+    HierarchyState& state;
+    size_t open_limit; ///< Directories on the path (and on a probe's) that keep their descriptors.
+    vector<PrunedLevel> levels; ///< One per depth, from the root down.
+    InodeSet empty_subtrees;      ///< Directories probed without finding a file.
+    InodeSet subtrees_with_files; ///< Directories a file was found in or below.
+};
+
+/**
+ * @brief Reads the listing of a directory joining the current path.
+ */
+void PrunedWalker::start_level(
+    PrunedLevel& level,
+    OpenDirectory directory,
+    shared_ptr<const GitignoreScope> gitignore
+) {
+    level.directory = std::move(directory);
+    level.gitignore = std::move(gitignore);
+    level.listing = read_directory_listing(
+        level.directory, options, level.gitignore.get(), state.snapshot
+    );
+    level.shown.resize(level.listing.entries.size());
+    for (size_t i = 0; i < level.shown.size(); i++)
+        level.shown[i] = level.listing.entries[i].is_directory() ? -1 : 1;
+}
+
+/**
+ * @brief Whether an entry of a level is printed, probing a directory once.
+ */
+bool PrunedWalker::entry_is_shown(PrunedLevel& level, size_t index) {
+    if (level.shown[index] < 0) {
+        string_view name = level.listing.entries[index].name;
+        OpenDirectory subdirectory = open_subdirectory(level.directory, name, options.backend);
+        shared_ptr<const GitignoreScope> subdirectory_gitignore;
+        if (level.gitignore)
+            subdirectory_gitignore = GitignoreScope::open_subdirectory(
+                level.gitignore, subdirectory, name
+            );
+        level.shown[index] = subtree_has_files(
+            std::move(subdirectory), std::move(subdirectory_gitignore)
+        );
+    }
+    return level.shown[index] == 1;
+}
+
+/**
+ * @brief Whether anything is printed after the current entry of a level.
+ */
+bool PrunedWalker::later_entry_is_shown(PrunedLevel& level) {
+    for (size_t i = level.index + 1; i < level.listing.entries.size(); i++)
+        if (entry_is_shown(level, i)) return true;
+    return level.listing.omitted_count > 0;
+}
+
+/**
+ * @brief Reads a directory a probe descends into.
+ *
+ * Directories probed before, by any level, are answered from what the
+ * probe found then. With --follow-links, directories the walk already
+ * entered count as empty, since they are not listed again, and @p probed
+ * keeps the probe out of link cycles.
+ */
+ProbeStart PrunedWalker::start_probe_frame(
+    ProbeFrame& frame,
+    OpenDirectory directory,
+    shared_ptr<const GitignoreScope> gitignore,
+    InodeSet& probed
+) {
+    frame.identified = directory_identity(directory, frame.device, frame.inode);
+    if (options.follow_links) {
+        if (!frame.identified || state.visited_directories.contains(frame.device, frame.inode))
+            return ProbeStart::EMPTY;
+        if (!probed.insert(frame.device, frame.inode)) return ProbeStart::CYCLE;
+    }
+    if (frame.identified) {
+        if (empty_subtrees.contains(frame.device, frame.inode)) return ProbeStart::EMPTY;
+        if (subtrees_with_files.contains(frame.device, frame.inode)) return ProbeStart::HAS_FILES;
+    }
+    frame.directory = std::move(directory);
+    frame.gitignore = std::move(gitignore);
+    frame.listing = read_directory_listing(frame.directory, probe_options, frame.gitignore.get());
+    for (const ListedEntry& entry : frame.listing.entries)
+        if (!entry.is_directory()) return ProbeStart::HAS_FILES;
+    return ProbeStart::DESCEND;
+}
+
+/**
+ * @brief Whether a file is listed anywhere below a directory.
+ *
+ * Stops at the first file, looking at the files of a directory before
+ * descending into its subdirectories. The directories being looked
+ * through form an explicit stack, like the walk itself, and release their
+ * descriptors past open_limit levels the same way.
+ *
+ * Every probed directory is remembered by (device, inode) as empty or as
+ * holding a file, so the probes of enclosing levels reaching it later
+ * read it no more: a directory is read at most once by probes and once
+ * by the walk. With --follow-links, a directory only counts as holding a
+ * file until the walk enters it, so only empty ones are remembered, and
+ * not when a link cycle was skipped below them.
+ */
+bool PrunedWalker::subtree_has_files(
+    OpenDirectory directory,
+    shared_ptr<const GitignoreScope> gitignore
+) {
+    InodeSet probed;
+    vector<ProbeFrame> stack(1);
+    ProbeStart start = start_probe_frame(
+        stack.back(), std::move(directory), std::move(gitignore), probed
+    );
+    while (!stack.empty()) {
+        if (start == ProbeStart::HAS_FILES) {
+            // Everything on the probe's path holds the file found
+            if (!options.follow_links)
+                for (const ProbeFrame& frame : stack)
+                    if (frame.identified) subtrees_with_files.insert(frame.device, frame.inode);
+            return true;
+        }
+        if (start == ProbeStart::CYCLE)
+            for (ProbeFrame& frame : stack)
+                frame.cut_short = true;
+        if (start != ProbeStart::DESCEND) stack.pop_back();
+        start = ProbeStart::DESCEND;
+        if (stack.empty()) break;
+        ProbeFrame& frame = stack.back();
+        if (frame.index == frame.listing.entries.size()) {
+            if (frame.identified && !frame.cut_short)
+                empty_subtrees.insert(frame.device, frame.inode);
+            if (stack.size() > 1 && stack[stack.size() - 2].released) {
+                reacquire_directory(stack[stack.size() - 2].directory, frame.directory);
+                stack[stack.size() - 2].released = false;
+            }
+            stack.pop_back();
+            continue;
+        }
+        string_view name = frame.listing.entries[frame.index++].name;
+        OpenDirectory subdirectory = open_subdirectory(frame.directory, name, options.backend);
+        shared_ptr<const GitignoreScope> subdirectory_gitignore;
+        if (frame.gitignore)
+            subdirectory_gitignore = GitignoreScope::open_subdirectory(
+                frame.gitignore, subdirectory, name
+            );
+        stack.emplace_back();
+        start = start_probe_frame(
+            stack.back(), std::move(subdirectory), std::move(subdirectory_gitignore), probed
+        );
+        if (start != ProbeStart::DESCEND || stack.size() <= open_limit) continue;
+        ProbeFrame& upper = stack[stack.size() - open_limit - 1];
+        if (!upper.released)
+            upper.released = release_directory(
+                upper.directory, stack[stack.size() - open_limit].directory
+            );
+    }
+    return false;
+}
+
+/**
+ * @brief Writes the lines of the directories on the path that were held back.
+ */
+void PrunedWalker::write_pending_lines() {
+    size_t depth = levels.size();
+    while (depth > 0 && !levels[depth - 1].written)
+        depth--;
+    for (; depth < levels.size(); depth++) {
+        PrunedLevel& parent = levels[depth - 1];
+        print_listed_entry(parent.listing, parent.index, state, depth, !later_entry_is_shown(parent));
+        state.emitter.begin_entries(depth);
+        levels[depth].written = true;
+    }
+}
+
+/**
+ * @brief Walks a tree depth-first from its root directory.
+ *
+ * The directories on the path form an explicit stack, so the depth of the
+ * tree is not limited by the call stack. A level's index stays on the
+ * subdirectory being walked until the walk returns to it. Only the
+ * open_limit deepest levels keep their descriptors; a level probes its
+ * later siblings up to the first shown one before it is released, so
+ * writing its pending line later needs no descriptor, and it is reopened
+ * through ".." on the way back up.
+ */
+void PrunedWalker::walk_root(
+    OpenDirectory directory,
+    shared_ptr<const GitignoreScope> gitignore
+) {
+    levels.emplace_back();
+    start_level(levels.back(), std::move(directory), std::move(gitignore));
+    levels.back().written = true;
+    state.emitter.begin_entries(0);
+    while (!levels.empty()) {
+        PrunedLevel& level = levels.back();
+        unsigned int entry_depth = levels.size();
+        if (level.index == level.listing.entries.size()) {
+            // The omitted-entries line counts as printed, like a file
+            if (level.listing.omitted_count > 0) {
+                write_pending_lines();
+                print_omitted_entries(level.listing.omitted_count, state, entry_depth);
+            }
+            if (level.written)
+                state.emitter.end_entries();
+            if (levels.size() > 1 && levels[levels.size() - 2].released) {
+                reacquire_directory(levels[levels.size() - 2].directory, level.directory);
+                levels[levels.size() - 2].released = false;
+            }
+            levels.pop_back();
+            if (!levels.empty()) levels.back().index++;
+            continue;
+        }
+        const ListedEntry& entry = level.listing.entries[level.index];
+        if (!entry.is_directory()) {
+            write_pending_lines();
+            print_listed_entry(level.listing, level.index, state, entry_depth,
+                !later_entry_is_shown(level));
+            level.index++;
+            continue;
+        }
+        if (level.shown[level.index] == 0) {
+            level.index++;
+            continue;
+        }
+        // Past the depth limit, a directory holding files is shown but not listed
+        if (!lists_entries_at(options, entry_depth)) {
+            if (entry_is_shown(level, level.index)) {
+                write_pending_lines();
+                print_listed_entry(level.listing, level.index, state, entry_depth,
+                    !later_entry_is_shown(level));
+            }
+            level.index++;
+            continue;
+        }
+        OpenDirectory subdirectory = open_subdirectory(
+            level.directory, entry.name, options.backend
+        );
+        if (options.follow_links && !enter_directory_once(subdirectory, state)) {
+            level.index++;
+            continue;
+        }
+        shared_ptr<const GitignoreScope> subdirectory_gitignore;
+        if (level.gitignore)
+            subdirectory_gitignore = GitignoreScope::open_subdirectory(
+                level.gitignore, subdirectory, entry.name
+            );
+        PrunedLevel child;
+        start_level(child, std::move(subdirectory), std::move(subdirectory_gitignore));
+        levels.push_back(std::move(child));
+        if (levels.size() > open_limit) {
+            PrunedLevel& upper = levels[levels.size() - open_limit - 1];
+            if (!upper.released) {
+                later_entry_is_shown(upper);
+                upper.released = release_directory(
+                    upper.directory, levels[levels.size() - open_limit].directory
+                );
+            }
+        }
+    }
+}
+
+}
+
+void generate_directory_hierarchy_pruned(
+    string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state
+) {
+    if (!path_is_valid(path, state, 0)) return;
+    OpenDirectory directory = open_root_directory(path, options.backend);
+    if (options.follow_links) enter_directory_once(directory, state);
+    shared_ptr<const GitignoreScope> gitignore;
+    if (options.use_gitignore)
+        gitignore = GitignoreScope::open_root(directory);
+    print_directory_header(path, state, 0);
+    PrunedWalker walker(options, state);
+    walker.walk_root(std::move(directory), std::move(gitignore));
+}
@@ -0,0 +1,150 @@
+#include "../include/run_stats.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+using std::vector;
+
+namespace run_stats_detail {
+
+std::atomic<bool> enabled{false};
+
+namespace {
+
+// Counters of every thread that ever counted; they outlive their threads.
+std::mutex registry_mutex;
+vector<unique_ptr<ThreadCounters>> registry;
+
+}
+
+ThreadCounters& thread_counters() {
+    thread_local ThreadCounters* counters = nullptr;
+    if (!counters) {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadCounters>());
+        counters = registry.back().get();
+    }
+    return *counters;
+}
+
+uint64_t thread_cpu_ns() {
+#ifdef __linux__
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0)
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+    return 0;
+}
+
+/**
+ * @brief Sums a field over the counters of every thread.
+ */
+template <typename Field>
+static uint64_t total(Field field) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    uint64_t sum = 0;
+    for (const auto& counters : registry)
+        sum += field(*counters).load(std::memory_order_relaxed);
+    return sum;
+}
+
+}
+
+using namespace run_stats_detail;
+
+/**
+ * @brief CPU time of the whole process so far.
+ */
+static uint64_t process_cpu_ns() {
+#ifdef __linux__
+    timespec now;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now) == 0)
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+    return 0;
+}
+
+void RunStats::start() {
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (const auto& counters : registry) {
+            for (auto& counter : counters->counters) counter.store(0, std::memory_order_relaxed);
+            for (auto& phase : counters->wall_ns) phase.store(0, std::memory_order_relaxed);
+            for (auto& phase : counters->cpu_ns) phase.store(0, std::memory_order_relaxed);
+        }
+    }
+    slowest.clear();
+    peak_entries = 0;
+    peak_directory.clear();
+    start_time = std::chrono::steady_clock::now();
+    start_cpu_ns = process_cpu_ns();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void RunStats::record_directory_wait(string_view path, uint64_t wait_ns) {
+    if (slowest.size() == SLOWEST_COUNT && wait_ns <= slowest.back().first) return;
+    auto position = std::find_if(slowest.begin(), slowest.end(),
+        [&](const auto& other) { return other.first < wait_ns; });
+    slowest.insert(position, {wait_ns, string(path)});
+    if (slowest.size() > SLOWEST_COUNT) slowest.pop_back();
+}
+
+void RunStats::record_directory_size(string_view path, size_t entry_count) {
+    if (entry_count <= peak_entries) return;
+    peak_entries = entry_count;
+    peak_directory.assign(path);
+}
+
+static string seconds(uint64_t nanoseconds) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.6f", nanoseconds / 1e9);
+    return text;
+}
+
+void RunStats::report(std::ostream& stream) const {
+    auto wall = std::chrono::steady_clock::now() - start_time;
+    uint64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count();
+    uint64_t phase_wall[PHASE_COUNT];
+    uint64_t phase_cpu[PHASE_COUNT];
+    for (unsigned int phase = 0; phase < PHASE_COUNT; phase++) {
+        phase_wall[phase] = total([&](ThreadCounters& c) -> auto& { return c.wall_ns[phase]; });
+        phase_cpu[phase] = total([&](ThreadCounters& c) -> auto& { return c.cpu_ns[phase]; });
+    }
+    // Output happens inside the emitter calls that render
+    phase_wall[PHASE_RENDER] -= std::min(phase_wall[PHASE_RENDER], phase_wall[PHASE_OUTPUT]);
+    phase_cpu[PHASE_RENDER] -= std::min(phase_cpu[PHASE_RENDER], phase_cpu[PHASE_OUTPUT]);
+    auto counter = [](StatsCounter index) {
+        return total([&](ThreadCounters& c) -> auto& { return c.counters[index]; });
+    };
+    static const char* const PHASE_NAMES[PHASE_COUNT] = {"read", "stat", "sort", "render", "output"};
+    stream << "\nStatistics:\n";
+    stream << "  total       wall " << seconds(wall_ns) << " s, cpu "
+           << seconds(process_cpu_ns() - start_cpu_ns) << " s\n";
+    for (unsigned int phase = 0; phase < PHASE_COUNT; phase++) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "  %-10s  wall %s s, cpu %s s\n", PHASE_NAMES[phase],
+            seconds(phase_wall[phase]).c_str(), seconds(phase_cpu[phase]).c_str());
+        stream << line;
+    }
+    stream << "  syscalls    opendir " << counter(STATS_OPENDIR)
+           << ", getdents " << counter(STATS_GETDENTS)
+           << ", stat " << counter(STATS_STAT) << "\n";
+    stream << "  output      " << counter(STATS_BYTES_WRITTEN) << " bytes in "
+           << counter(STATS_WRITE) << " writes\n";
+    stream << "  peak        " << peak_entries << " entries";
+    if (!peak_directory.empty()) stream << " in " << peak_directory;
+    stream << "\n";
+    if (!slowest.empty()) stream << "  slowest directories (time until their entries started):\n";
+    for (const auto& [wait_ns, path] : slowest)
+        stream << "    " << seconds(wait_ns) << " s  " << path << "\n";
+    stream.flush();
+}
@@ -0,0 +1,363 @@
+#include "../include/snapshot_cache.hpp"
+#include "../include/entry_sort.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::string_view;
+
+namespace {
+
+// Layout of a snapshot file: FileHeader, records, then the sorted index.
+// Every part starts at a multiple of 8 bytes so the mapping can be read in place.
+constexpr char SNAPSHOT_MAGIC[8] = {'L', 'S', 'T', 'R', 'E', 'E', 'S', '1'};
+
+struct FileHeader {
+    char magic[8];
+    uint64_t record_count;
+    uint64_t index_offset;
+};
+
+struct IndexEntry {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t offset;
+};
+
+// A record is a RecordHeader, entry_count EntryRecords and the NUL-terminated
+// names, padded to a multiple of 8.
+struct RecordHeader {
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint32_t entry_count;
+    uint32_t names_size;
+};
+
+struct EntryRecord {
+    uint64_t inode;
+    uint32_t name_offset;
+    uint16_t name_length;
+    uint8_t type;
+    uint8_t reserved;
+};
+
+size_t padded(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+size_t record_size(const RecordHeader& header) {
+    return sizeof(RecordHeader) + header.entry_count * sizeof(EntryRecord)
+        + padded(header.names_size);
+}
+
+bool is_entry_name(string_view name) {
+    return !name.empty() && name != "." && name != ".."
+        && name.find('/') == string_view::npos
+        && name.find('\0') == string_view::npos;
+}
+
+template <typename T>
+void append_bytes(string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+}
+
+#ifdef __linux__
+
+/**
+ * @brief Reads the stamp of an open directory with a single fstat or stat.
+ */
+static bool stamp_directory(const OpenDirectory& directory, DirectoryStamp& stamp) {
+    struct stat status;
+    int result = (directory.fd >= 0)
+        ? fstat(directory.fd, &status)
+        : stat(directory.path.c_str(), &status);
+    if (result != 0) return false;
+    stamp.device = status.st_dev;
+    stamp.inode = status.st_ino;
+    stamp.mtime_ns = status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+    stamp.ctime_ns = status.st_ctim.tv_sec * 1000000000LL + status.st_ctim.tv_nsec;
+    return true;
+}
+
+SnapshotCache::SnapshotCache(string path) : path(std::move(path)) {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    start_time_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    int fd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat status;
+    if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(FileHeader)) {
+        void* mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            mapping = static_cast<const char*>(mapped);
+            mapping_size = status.st_size;
+        }
+    }
+    close(fd);
+    if (!mapping) return;
+    // An unrecognized or truncated file is treated as an empty snapshot
+    const auto* header = reinterpret_cast<const FileHeader*>(mapping);
+    bool valid = std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+        && header->index_offset >= sizeof(FileHeader)
+        && header->index_offset % 8 == 0
+        && header->index_offset <= mapping_size
+        && header->record_count <= (mapping_size - header->index_offset) / sizeof(IndexEntry);
+    if (valid) {
+        record_count = header->record_count;
+        index_offset = header->index_offset;
+    }
+}
+
+SnapshotCache::~SnapshotCache() {
+    if (mapping) munmap(const_cast<char*>(mapping), mapping_size);
+}
+
+/**
+ * @brief Resolves an index entry to its record, if it lies within the records.
+ *
+ * @return The record, or nullptr if the entry points outside of them.
+ */
+const char* SnapshotCache::record_at(uint64_t offset) const {
+    if (offset % 8 != 0 || offset < sizeof(FileHeader)
+        || offset + sizeof(RecordHeader) > index_offset)
+        return nullptr;
+    const char* record = mapping + offset;
+    const auto* header = reinterpret_cast<const RecordHeader*>(record);
+    if (record_size(*header) > index_offset - offset) return nullptr;
+    return record;
+}
+
+/**
+ * @brief Finds the record of a directory whose stamp has not changed.
+ *
+ * @return The record, or nullptr if the directory must be read again.
+ */
+const char* SnapshotCache::find_record(const DirectoryStamp& stamp) const {
+    if (record_count == 0) return nullptr;
+    const auto* index = reinterpret_cast<const IndexEntry*>(mapping + index_offset);
+    const IndexEntry* entry = std::lower_bound(index, index + record_count, stamp,
+        [](const IndexEntry& item, const DirectoryStamp& key) {
+            return item.device != key.device ? item.device < key.device : item.inode < key.inode;
+        }
+    );
+    if (entry == index + record_count
+        || entry->device != stamp.device || entry->inode != stamp.inode)
+        return nullptr;
+    const char* record = record_at(entry->offset);
+    if (!record) return nullptr;
+    const auto* header = reinterpret_cast<const RecordHeader*>(record);
+    if (header->mtime_ns != stamp.mtime_ns || header->ctime_ns != stamp.ctime_ns)
+        return nullptr;
+    return record;
+}
+
+/**
+ * @brief Replays a directory from the snapshot when its stamp is unchanged.
+ *
+ * Otherwise reads it with the backend and serializes the raw entries right
+ * away, before the caller resolves or filters them.
+ */
+void SnapshotCache::read_entries(
+    const OpenDirectory& directory,
+    ReadBackend backend,
+    DirectoryListing& listing
+) {
+    size_t first_entry = listing.entries.size();
+    DirectoryStamp stamp;
+    if (!stamp_directory(directory, stamp)) {
+        read_directory_entries(directory, backend, {}, listing);
+        return;
+    }
+    if (const char* record = find_record(stamp)) {
+        const auto* header = reinterpret_cast<const RecordHeader*>(record);
+        const auto* entries = reinterpret_cast<const EntryRecord*>(record + sizeof(RecordHeader));
+        const char* names = reinterpret_cast<const char*>(entries + header->entry_count);
+        listing.entries.reserve(first_entry + header->entry_count);
+        bool intact = true;
+        for (uint32_t i = 0; i < header->entry_count && intact; i++) {
+            const EntryRecord& entry = entries[i];
+            // Names must stay in bounds and NUL-terminated for openat(), and
+            // name an entry of this directory so a damaged file cannot loop
+            intact = entry.type <= static_cast<uint8_t>(EntryType::SYMLINK)
+                && size_t(entry.name_offset) + entry.name_length < header->names_size
+                && names[entry.name_offset + entry.name_length] == '\0';
+            if (!intact) break;
+            string_view name(names + entry.name_offset, entry.name_length);
+            intact = is_entry_name(name);
+            listing.entries.push_back(make_listed_entry(
+                name, static_cast<EntryType>(entry.type), entry.inode
+            ));
+        }
+        if (intact) {
+            visited.push_back({stamp.device, stamp.inode,
+                static_cast<uint64_t>(record - mapping), record_size(*header), false});
+            return;
+        }
+        listing.entries.resize(first_entry);
+    }
+    read_directory_entries(directory, backend, {}, listing);
+    // A directory changed within the current timestamp tick could change
+    // again unnoticed, so its record is stored with a stamp that never matches
+    bool settled = stamp.mtime_ns < start_time_ns - 1000000000LL
+        && stamp.ctime_ns < start_time_ns - 1000000000LL;
+    RecordHeader header = {stamp.device, stamp.inode,
+        settled ? stamp.mtime_ns : -1, settled ? stamp.ctime_ns : -1,
+        static_cast<uint32_t>(listing.entries.size() - first_entry), 0};
+    for (size_t i = first_entry; i < listing.entries.size(); i++)
+        header.names_size += listing.entries[i].name.size() + 1;
+    size_t start = fresh_records.size();
+    fresh_records.reserve(start + record_size(header));
+    append_bytes(fresh_records, header);
+    uint32_t name_offset = 0;
+    for (size_t i = first_entry; i < listing.entries.size(); i++) {
+        const ListedEntry& entry = listing.entries[i];
+        EntryRecord record = {entry.inode, name_offset,
+            static_cast<uint16_t>(entry.name.size()), static_cast<uint8_t>(entry.type), 0};
+        append_bytes(fresh_records, record);
+        name_offset += entry.name.size() + 1;
+    }
+    for (size_t i = first_entry; i < listing.entries.size(); i++) {
+        fresh_records.append(listing.entries[i].name);
+        fresh_records += '\0';
+    }
+    fresh_records.resize(start + record_size(header), '\0');
+    visited.push_back({stamp.device, stamp.inode, start, record_size(header), true});
+    fresh_count++;
+}
+
+/**
+ * @brief Writes the visited records to a temporary file and renames it over
+ * the snapshot, so a concurrent run maps either the old or the new file.
+ *
+ * A directory visited twice, under overlapping roots, keeps its last record.
+ * Records of directories this run did not visit (left out by -i, -L,
+ * --gitignore or --prune, or under other roots) are carried over as they
+ * were; a stale one is harmless, since its stamp no longer matches.
+ */
+bool SnapshotCache::save() {
+    if (fresh_count == 0) return true;
+    auto by_identity = [](const VisitedRecord& a, const VisitedRecord& b) {
+        return a.device != b.device ? a.device < b.device : a.inode < b.inode;
+    };
+    std::vector<size_t> order(visited.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return by_identity(visited[a], visited[b]);
+    });
+    std::vector<bool> superseded(visited.size(), false);
+    std::vector<VisitedRecord> kept;
+    kept.reserve(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        if (i + 1 < order.size() && !by_identity(visited[order[i]], visited[order[i + 1]]))
+            superseded[order[i]] = true;
+        else
+            kept.push_back(visited[order[i]]);
+    }
+    // Written in walk order, then the carried-over records in their old order
+    std::vector<VisitedRecord> records;
+    records.reserve(kept.size() + record_count);
+    for (size_t i = 0; i < visited.size(); i++)
+        if (!superseded[i]) records.push_back(visited[i]);
+    const auto* old_index = reinterpret_cast<const IndexEntry*>(mapping + index_offset);
+    for (uint64_t i = 0; i < record_count; i++) {
+        const IndexEntry& entry = old_index[i];
+        if (i > 0 && entry.device == old_index[i - 1].device
+            && entry.inode == old_index[i - 1].inode)
+            continue;
+        VisitedRecord key = {entry.device, entry.inode, 0, 0, false};
+        if (std::binary_search(kept.begin(), kept.end(), key, by_identity)) continue;
+        const char* record = record_at(entry.offset);
+        if (!record) continue;
+        const auto* record_header = reinterpret_cast<const RecordHeader*>(record);
+        if (record_header->device != entry.device || record_header->inode != entry.inode)
+            continue;
+        records.push_back({entry.device, entry.inode, entry.offset,
+            record_size(*record_header), false});
+    }
+    std::sort(records.begin() + kept.size(), records.end(),
+        [](const VisitedRecord& a, const VisitedRecord& b) { return a.offset < b.offset; });
+    std::vector<IndexEntry> index;
+    index.reserve(records.size());
+    uint64_t offset = sizeof(FileHeader);
+    for (const auto& record : records) {
+        index.push_back({record.device, record.inode, offset});
+        offset += record.size;
+    }
+    std::sort(index.begin(), index.end(), [](const IndexEntry& a, const IndexEntry& b) {
+        return a.device != b.device ? a.device < b.device : a.inode < b.inode;
+    });
+    FileHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.record_count = index.size();
+    header.index_offset = offset;
+    string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& record : records) {
+            const char* bytes = record.fresh
+                ? fresh_records.data() + record.offset
+                : mapping + record.offset;
+            file.write(bytes, record.size);
+        }
+        file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+        if (!file.flush()) {
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+    }
+    return std::rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+#else
+
+SnapshotCache::SnapshotCache(string path) : path(std::move(path)) {}
+
+SnapshotCache::~SnapshotCache() {}
+
+const char* SnapshotCache::record_at(uint64_t) const {
+    return nullptr;
+}
+
+const char* SnapshotCache::find_record(const DirectoryStamp&) const {
+    return nullptr;
+}
+
+void SnapshotCache::read_entries(
+    const OpenDirectory& directory,
+    ReadBackend backend,
+    DirectoryListing& listing
+) {
+    read_directory_entries(directory, backend, {}, listing);
+}
+
+bool SnapshotCache::save() {
+    return true;
+}
+
+#endif
+
+/**
+ * @brief Whether snapshot files are supported on this platform.
+ */
+bool snapshot_cache_available() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
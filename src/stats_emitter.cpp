@@ -0,0 +1,68 @@
+#include "../include/stats_emitter.hpp"
+
+using std::string_view;
+
+void StatsEmitter::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    {
+        PhaseTimer timer(PHASE_RENDER);
+        inner->write_entry(name, depth, is_directory, is_last, metadata);
+    }
+    if (!entry_counts.empty()) entry_counts.back()++;
+    if (is_directory) {
+        last_directory.assign(name);
+        last_directory_time = std::chrono::steady_clock::now();
+    }
+}
+
+void StatsEmitter::write_link(
+    string_view name,
+    string_view target,
+    unsigned int depth,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    {
+        PhaseTimer timer(PHASE_RENDER);
+        inner->write_link(name, target, depth, is_last, metadata);
+    }
+    if (!entry_counts.empty()) entry_counts.back()++;
+}
+
+void StatsEmitter::begin_entries(unsigned int depth) {
+    path_lengths.push_back(directory_path.size());
+    directory_path += last_directory;
+    if (directory_path.empty() || directory_path.back() != '/')
+        directory_path += '/';
+    entry_counts.push_back(0);
+    auto wait = std::chrono::steady_clock::now() - last_directory_time;
+    stats.record_directory_wait(directory_path,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count());
+    PhaseTimer timer(PHASE_RENDER);
+    inner->begin_entries(depth);
+}
+
+void StatsEmitter::end_entries() {
+    stats.record_directory_size(directory_path, entry_counts.back());
+    entry_counts.pop_back();
+    directory_path.resize(path_lengths.back());
+    path_lengths.pop_back();
+    PhaseTimer timer(PHASE_RENDER);
+    inner->end_entries();
+}
+
+void StatsEmitter::write_omitted(size_t omitted_count, unsigned int depth) {
+    if (!entry_counts.empty()) entry_counts.back() += omitted_count;
+    PhaseTimer timer(PHASE_RENDER);
+    inner->write_omitted(omitted_count, depth);
+}
+
+void StatsEmitter::write_summary(unsigned int directory_count, unsigned int file_count) {
+    PhaseTimer timer(PHASE_RENDER);
+    inner->write_summary(directory_count, file_count);
+}
@@ -0,0 +1,285 @@
+#include "../include/streaming_walker.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace {
+
+/**
+ * @struct StreamedEntry
+ * @brief An entry held back by the lookahead, with its own copy of the name.
+ */
+struct StreamedEntry {
+    ListedEntry entry;
+    string name;
+};
+
+}
+
+/**
+ * @brief Reads the next entry of a directory that is printed.
+ *
+ * Applies the same filters as read_directory_listing(), in the same order:
+ * ignored names are skipped before any stat, .gitignore rules after the
+ * entry's type is known.
+ *
+ * @param cursor The cursor reading the directory.
+ * @param directory The directory being read.
+ * @param options The ignore settings of the current run.
+ * @param gitignore The .gitignore rules of the directory, or nullptr.
+ * @param streamed Receives the entry; its name outlives the cursor's buffer.
+ * @return false once the directory has no more listable entries.
+ */
+static bool next_listed_entry(
+    DirectoryCursor& cursor,
+    const OpenDirectory& directory,
+    const HierarchyOptions& options,
+    const GitignoreScope* gitignore,
+    StreamedEntry& streamed
+) {
+    ListedEntry entry;
+    while (cursor.next(entry)) {
+        if (options.ignore.matches(entry.name)) continue;
+        if (!resolve_entry_type(directory, entry, options.follow_links)) continue;
+        if (!passes_match(options, entry)) continue;
+        if (gitignore && gitignore->is_ignored(entry.name, entry.is_directory())) continue;
+        streamed.name.assign(entry.name);
+        streamed.entry = entry;
+        streamed.entry.name = streamed.name;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Counts the entries left in a directory cut off by --max-entries-per-dir.
+ *
+ * Like keep_first_entries(), symlinks are counted without being resolved
+ * unless .gitignore rules or --match need the entry's type.
+ */
+static size_t count_remaining_entries(
+    DirectoryCursor& cursor,
+    const OpenDirectory& directory,
+    const HierarchyOptions& options,
+    const GitignoreScope* gitignore
+) {
+    size_t count = 0;
+    ListedEntry entry;
+    while (cursor.next(entry)) {
+        if (options.ignore.matches(entry.name)) continue;
+        if (gitignore || !options.match.empty()) {
+            if (!resolve_entry_type(directory, entry, options.follow_links)) continue;
+            if (!passes_match(options, entry)) continue;
+            if (gitignore && gitignore->is_ignored(entry.name, entry.is_directory())) continue;
+        }
+        count++;
+    }
+    return count;
+}
+
+namespace {
+
+/**
+ * @struct StreamFrame
+ * @brief A directory whose entries the streaming walker is printing.
+ *
+ * Held through a unique_ptr, since the cursor refers to the directory.
+ */
+struct StreamFrame {
+    OpenDirectory directory;
+    shared_ptr<const GitignoreScope> gitignore;
+    std::unique_ptr<DirectoryCursor> cursor; ///< Null once the rest was read ahead.
+    // Entries alternate between the two slots, so names never move
+    StreamedEntry slots[2];
+    unsigned int current = 0;
+    bool has_current = false;
+    size_t printed_count = 0;
+    size_t omitted_count = 0;
+    std::deque<StreamedEntry> rest; ///< Entries read ahead to release the descriptor.
+    size_t rest_omitted_count = 0;  ///< What the cap cuts off after them.
+    bool released = false;          ///< Whether the descriptor is closed until the walk returns here.
+};
+
+}
+
+static std::unique_ptr<StreamFrame> open_stream_frame(
+    OpenDirectory directory,
+    shared_ptr<const GitignoreScope> gitignore,
+    const HierarchyOptions& options
+) {
+    auto frame = std::make_unique<StreamFrame>();
+    frame->directory = std::move(directory);
+    frame->gitignore = std::move(gitignore);
+    frame->cursor = std::make_unique<DirectoryCursor>(frame->directory, options.backend);
+    frame->has_current = next_listed_entry(
+        *frame->cursor, frame->directory, options, frame->gitignore.get(), frame->slots[0]
+    );
+    return frame;
+}
+
+/**
+ * @brief Reads the next printed entry of a frame, from its cursor or what was read ahead.
+ */
+static bool next_frame_entry(
+    StreamFrame& frame,
+    const HierarchyOptions& options,
+    StreamedEntry& streamed
+) {
+    if (frame.cursor)
+        return next_listed_entry(*frame.cursor, frame.directory, options, frame.gitignore.get(), streamed);
+    if (frame.rest.empty()) return false;
+    streamed.name = std::move(frame.rest.front().name);
+    streamed.entry = frame.rest.front().entry;
+    streamed.entry.name = streamed.name;
+    frame.rest.pop_front();
+    return true;
+}
+
+/**
+ * @brief Reads the rest of a frame's directory, so its descriptor can be released.
+ *
+ * Only the entries the cap still lets through are kept; the ones after are
+ * counted for the "… (N more)" line, exactly as the cursor would have.
+ */
+static void read_rest_of_frame(StreamFrame& frame, const HierarchyOptions& options) {
+    if (!frame.cursor) return;
+    size_t cap = options.max_entries_per_directory;
+    if (frame.has_current) {
+        // The current slot holds the next entry to print, read before the rest
+        size_t wanted = cap ? cap - frame.printed_count - 1 : SIZE_MAX;
+        StreamedEntry streamed;
+        while (frame.rest.size() < wanted && next_listed_entry(
+            *frame.cursor, frame.directory, options, frame.gitignore.get(), streamed
+        ))
+            frame.rest.push_back(streamed);
+        if (cap && frame.rest.size() == wanted)
+            frame.rest_omitted_count = count_remaining_entries(
+                *frame.cursor, frame.directory, options, frame.gitignore.get()
+            );
+    }
+    frame.cursor.reset();
+}
+
+/**
+ * @brief Prints the entries of a directory and their subtrees while reading them.
+ *
+ * Holds two entries per level: the one being printed and the one read
+ * after it. A directory stays open (and its cursor mid-read) while the
+ * subtree of the printed entry is walked. The directories being walked
+ * form an explicit stack, so the call stack does not grow with the depth
+ * of the tree; past open_directory_limit() levels, a directory has the
+ * rest of its entries read ahead and its descriptor released, to be
+ * reopened through ".." on the way back up.
+ *
+ * @param directory The open root directory.
+ * @param gitignore The .gitignore rules of the directory, or nullptr.
+ * @param options The spacing, ignore and limit settings of the current run.
+ * @param state The rendering state holding the emitter and counters.
+ */
+static void stream_directory(
+    OpenDirectory directory,
+    shared_ptr<const GitignoreScope> gitignore,
+    const HierarchyOptions& options,
+    HierarchyState& state
+) {
+    size_t open_limit = open_directory_limit();
+    size_t cap = options.max_entries_per_directory;
+    vector<std::unique_ptr<StreamFrame>> stack;
+    stack.push_back(open_stream_frame(std::move(directory), std::move(gitignore), options));
+    state.emitter.begin_entries(0);
+    EntryMetadata metadata;
+    string link_target;
+    while (!stack.empty()) {
+        StreamFrame& frame = *stack.back();
+        unsigned int entry_depth = stack.size();
+        if (!frame.has_current) {
+            if (frame.omitted_count > 0)
+                print_omitted_entries(frame.omitted_count, state, entry_depth);
+            state.emitter.end_entries();
+            if (stack.size() > 1 && stack[stack.size() - 2]->released) {
+                reacquire_directory(stack[stack.size() - 2]->directory, frame.directory);
+                stack[stack.size() - 2]->released = false;
+            }
+            stack.pop_back();
+            continue;
+        }
+        bool reaches_cap = cap != 0 && ++frame.printed_count == cap;
+        bool has_next = false;
+        if (reaches_cap) {
+            frame.omitted_count = frame.cursor
+                ? count_remaining_entries(*frame.cursor, frame.directory, options, frame.gitignore.get())
+                : frame.rest_omitted_count;
+        } else {
+            has_next = next_frame_entry(frame, options, frame.slots[frame.current ^ 1]);
+        }
+        const ListedEntry& entry = frame.slots[frame.current].entry;
+        if (options.metadata_fields) {
+            PhaseTimer stat_timer(PHASE_STAT);
+            read_entry_metadata(frame.directory, entry.name, options.metadata_fields, metadata,
+                !entry.is_link());
+        }
+        bool is_last = !has_next && frame.omitted_count == 0;
+        const EntryMetadata* shown_metadata = options.metadata_fields ? &metadata : nullptr;
+        if (entry.is_link()) {
+            read_link_target(frame.directory, entry.name, link_target);
+            state.emitter.write_link(entry.name, link_target, entry_depth, is_last, shown_metadata);
+        } else {
+            state.emitter.write_entry(entry.name, entry_depth, entry.is_directory(),
+                is_last, shown_metadata);
+        }
+        std::unique_ptr<StreamFrame> child;
+        if (!entry.is_directory()) {
+            state.file_count++;
+        } else {
+            state.directory_count++;
+            // Below the depth limit, directories are shown but never opened
+            if (lists_entries_at(options, entry_depth)) {
+                OpenDirectory subdirectory = open_subdirectory(
+                    frame.directory, entry.name, options.backend
+                );
+                shared_ptr<const GitignoreScope> subdirectory_gitignore;
+                if (frame.gitignore)
+                    subdirectory_gitignore = GitignoreScope::open_subdirectory(
+                        frame.gitignore, subdirectory, entry.name
+                    );
+                child = open_stream_frame(
+                    std::move(subdirectory), std::move(subdirectory_gitignore), options
+                );
+            }
+        }
+        // The printed slot is only reused once the subtree below it is done
+        frame.current ^= 1;
+        frame.has_current = has_next;
+        if (!child) continue;
+        state.emitter.begin_entries(entry_depth);
+        stack.push_back(std::move(child));
+        if (stack.size() > open_limit) {
+            StreamFrame& upper = *stack[stack.size() - open_limit - 1];
+            if (!upper.released && upper.directory.fd >= 0) {
+                read_rest_of_frame(upper, options);
+                upper.released = release_directory(
+                    upper.directory, stack[stack.size() - open_limit]->directory
+                );
+            }
+        }
+    }
+}
+
+void generate_directory_hierarchy_streaming(
+    string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state
+) {
+    if (!path_is_valid(path, state, 0)) return;
+    OpenDirectory directory = open_root_directory(path, options.backend);
+    shared_ptr<const GitignoreScope> gitignore;
+    if (options.use_gitignore)
+        gitignore = GitignoreScope::open_root(directory);
+    print_directory_header(path, state, 0);
+    stream_directory(std::move(directory), std::move(gitignore), options, state);
+}
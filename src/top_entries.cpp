@@ -0,0 +1,112 @@
+#include "../include/top_entries.hpp"
+#include <algorithm>
+
+using std::string_view;
+
+/**
+ * @brief Whether a candidate ranks before another: larger key, then walked earlier.
+ */
+bool TopEntriesEmitter::better(const Candidate& left, const Candidate& right) {
+    if (left.key != right.key) return left.key > right.key;
+    return left.sequence < right.sequence;
+}
+
+/**
+ * @brief The ranking value of a file, as an unsigned number.
+ *
+ * Modification times are signed, so their sign bit is flipped to keep
+ * times before the epoch in order.
+ */
+uint64_t TopEntriesEmitter::ranking_key(const EntryMetadata& metadata) const {
+    if (field == METADATA_SIZE) return metadata.size;
+    return static_cast<uint64_t>(metadata.mtime_ns) ^ (1ULL << 63);
+}
+
+void TopEntriesEmitter::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool,
+    const EntryMetadata* metadata
+) {
+    if (depth == 0) {
+        root.assign(name);
+        root_is_directory = is_directory;
+        return;
+    }
+    if (is_directory) {
+        last_directory.assign(name);
+        return;
+    }
+    add_candidate(name, metadata, false, {});
+}
+
+/**
+ * @brief Ranks a link among the files, by the link's own fields.
+ */
+void TopEntriesEmitter::write_link(
+    string_view name,
+    string_view target,
+    unsigned int,
+    bool,
+    const EntryMetadata* metadata
+) {
+    add_candidate(name, metadata, true, target);
+}
+
+/**
+ * @brief Puts a file or link into the running top list if it ranks high enough.
+ */
+void TopEntriesEmitter::add_candidate(
+    string_view name,
+    const EntryMetadata* metadata,
+    bool is_link,
+    string_view target
+) {
+    // Files whose field could not be read are not ranked
+    if (!metadata || !(metadata->fields & field)) return;
+    Candidate candidate{ranking_key(*metadata), sequence++, {}, *metadata, is_link, {}};
+    if (heap.size() == limit) {
+        if (limit == 0 || !better(candidate, heap.front())) return;
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.pop_back();
+    }
+    candidate.path = directory_path;
+    candidate.path.append(name);
+    candidate.target.assign(target);
+    heap.push_back(std::move(candidate));
+    std::push_heap(heap.begin(), heap.end(), better);
+}
+
+void TopEntriesEmitter::begin_entries(unsigned int depth) {
+    path_lengths.push_back(directory_path.size());
+    // Paths are shown below the root
+    if (depth == 0) return;
+    directory_path += last_directory;
+    directory_path += '/';
+}
+
+void TopEntriesEmitter::end_entries() {
+    directory_path.resize(path_lengths.back());
+    path_lengths.pop_back();
+}
+
+void TopEntriesEmitter::write_summary(unsigned int directory_count, unsigned int file_count) {
+    std::sort_heap(heap.begin(), heap.end(), better);
+    // A file given as the root is shown as usual
+    inner->write_entry(root, 0, root_is_directory, true, nullptr);
+    if (root_is_directory) {
+        inner->begin_entries(0);
+        for (size_t i = 0; i < heap.size(); i++) {
+            bool is_last = i + 1 == heap.size();
+            if (heap[i].is_link) {
+                inner->write_link(heap[i].path, heap[i].target, 1, is_last, &heap[i].metadata);
+            } else {
+                inner->write_entry(heap[i].path, 1, false, is_last, &heap[i].metadata);
+            }
+        }
+        inner->end_entries();
+    }
+    inner->write_summary(directory_count, file_count);
+    heap.clear();
+}
@@ -0,0 +1,329 @@
+#include "../include/tree_diff.hpp"
+#include "../include/binary_format.hpp"
+#include "../include/metadata_reader.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Node = DirectoryTree::Node;
+using NodeKind = DirectoryTree::NodeKind;
+
+/**
+ * @brief Scrambles the bits of a value (the splitmix64 finalizer).
+ */
+uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief The MetadataField bits carried by any file of a tree.
+ */
+unsigned int carried_fields(const DirectoryTree& tree) {
+    if (!tree.metadata(0)) return 0;
+    unsigned int fields = 0;
+    const auto& nodes = tree.nodes();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].kind == NodeKind::FILE)
+            fields |= tree.metadata(i)->fields;
+    }
+    return fields;
+}
+
+// A compared field, or 0 for a file whose stat failed.
+uint64_t file_size(const EntryMetadata& metadata) {
+    return (metadata.fields & METADATA_SIZE) ? metadata.size : 0;
+}
+
+int64_t file_mtime(const EntryMetadata& metadata) {
+    return (metadata.fields & METADATA_MTIME) ? mtime_seconds(metadata) : 0;
+}
+
+/**
+ * @class TreeDiffWriter
+ * @brief Merge-walks two trees and writes their differences.
+ */
+class TreeDiffWriter {
+public:
+    TreeDiffWriter(
+        const DirectoryTree& before,
+        const DirectoryTree& after,
+        unsigned int fields,
+        TreeEmitter& emitter
+    ) : before(before), after(after), fields(fields), emitter(emitter),
+        before_digests(digest_contents(before)), after_digests(digest_contents(after)) {}
+
+    /**
+     * @brief Whether the roots differ at all, which costs one comparison.
+     */
+    bool roots_differ() const {
+        return before_digests[0] != after_digests[0];
+    }
+
+    /**
+     * @brief Writes the differences below a pair of directories with the same name.
+     *
+     * The changed directories being written form an explicit stack, so the
+     * depth of the trees is not limited by the call stack.
+     *
+     * @param before_index The directory in the first tree.
+     * @param after_index The directory in the second tree.
+     * @param depth The depth of the directories.
+     */
+    void diff_directories(size_t before_index, size_t after_index, unsigned int depth) {
+        vector<DiffFrame> stack;
+        stack.push_back({merge_entries(before_index, after_index), 0, depth});
+        emitter.begin_entries(depth);
+        while (!stack.empty()) {
+            DiffFrame& frame = stack.back();
+            if (frame.next == frame.changes.size()) {
+                emitter.end_entries();
+                stack.pop_back();
+                continue;
+            }
+            Change change = frame.changes[frame.next++];
+            bool is_last = frame.next == frame.changes.size();
+            unsigned int entry_depth = frame.depth + 1;
+            switch (change.kind) {
+            case ADDED:
+                write_marked("+ ", after, change.after_index, entry_depth, is_last);
+                counts.added++;
+                break;
+            case REMOVED:
+                write_marked("- ", before, change.before_index, entry_depth, is_last);
+                counts.removed++;
+                break;
+            case CHANGED_ENTRY:
+                write_marked("~ ", after, change.after_index, entry_depth, is_last);
+                counts.changed++;
+                break;
+            case CHANGED_DIRECTORY:
+                emitter.write_entry(after.name(after.nodes()[change.after_index]),
+                    entry_depth, true, is_last, after.metadata(change.after_index));
+                emitter.begin_entries(entry_depth);
+                stack.push_back({
+                    merge_entries(change.before_index, change.after_index), 0, entry_depth
+                });
+                break;
+            }
+        }
+    }
+
+    TreeDiffCounts counts;
+
+private:
+    enum ChangeKind { ADDED, REMOVED, CHANGED_ENTRY, CHANGED_DIRECTORY };
+
+    // One line of the diff: an entry of either tree, or a pair of entries.
+    struct Change {
+        ChangeKind kind;
+        size_t before_index;
+        size_t after_index;
+    };
+
+    // A pair of changed directories whose differences are being written.
+    struct DiffFrame {
+        vector<Change> changes;
+        size_t next;        ///< The next change to write.
+        unsigned int depth; ///< The depth of the directories.
+    };
+
+    /**
+     * @brief Digests what each node holds, leaving out the node's own name.
+     *
+     * A file's digest covers the compared fields, and a link's its target.
+     * A directory's is the sum of its entries' digests, each mixed with the
+     * entry's name and kind, so it does not depend on the order the entries
+     * were listed in. One pass from the back, where every entry comes before
+     * its directory.
+     */
+    vector<uint64_t> digest_contents(const DirectoryTree& tree) const {
+        const auto& nodes = tree.nodes();
+        vector<uint64_t> digests(nodes.size(), 0);
+        for (size_t i = nodes.size(); i-- > 0;) {
+            const Node& node = nodes[i];
+            if (node.kind == NodeKind::FILE) {
+                const EntryMetadata* metadata = tree.metadata(i);
+                uint64_t digest = 0;
+                if (fields & METADATA_SIZE) digest = mix(digest ^ file_size(*metadata));
+                if (fields & METADATA_MTIME) digest = mix(digest ^ file_mtime(*metadata));
+                digests[i] = digest;
+            } else if (node.kind == NodeKind::LINK) {
+                digests[i] = mix(std::hash<string_view>()(tree.target(node)));
+            } else if (node.kind == NodeKind::DIRECTORY) {
+                uint64_t digest = 0;
+                for (size_t child = i + 1; child < node.subtree_end; child = nodes[child].subtree_end)
+                    digest += entry_digest(tree, child, digests[child]);
+                digests[i] = digest;
+            }
+        }
+        return digests;
+    }
+
+    static uint64_t entry_digest(const DirectoryTree& tree, size_t index, uint64_t contents) {
+        const Node& node = tree.nodes()[index];
+        // The "… (N more)" entries cannot be compared and are left out
+        if (node.kind == NodeKind::OMITTED) return 0;
+        uint64_t name_hash = std::hash<string_view>()(tree.name(node));
+        return mix(mix(name_hash + static_cast<uint64_t>(node.kind)) ^ contents);
+    }
+
+    /**
+     * @brief The entries of a directory in name order, "… (N more)" entries left out.
+     *
+     * Walked trees are already sorted; only unsorted dumps are sorted here.
+     */
+    static vector<size_t> sorted_entries(const DirectoryTree& tree, size_t directory) {
+        const auto& nodes = tree.nodes();
+        vector<size_t> entries;
+        for (size_t i = directory + 1; i < nodes[directory].subtree_end; i = nodes[i].subtree_end) {
+            if (nodes[i].kind != NodeKind::OMITTED)
+                entries.push_back(i);
+        }
+        auto name_less = [&](size_t a, size_t b) {
+            return tree.name(nodes[a]) < tree.name(nodes[b]);
+        };
+        if (!std::is_sorted(entries.begin(), entries.end(), name_less))
+            std::sort(entries.begin(), entries.end(), name_less);
+        return entries;
+    }
+
+    bool files_differ(size_t before_index, size_t after_index) const {
+        const EntryMetadata* first = before.metadata(before_index);
+        const EntryMetadata* second = after.metadata(after_index);
+        if ((fields & METADATA_SIZE) && file_size(*first) != file_size(*second)) return true;
+        return (fields & METADATA_MTIME) && file_mtime(*first) != file_mtime(*second);
+    }
+
+    /**
+     * @brief Pairs up the entries of two directories by name.
+     *
+     * An entry whose kind differs between the trees is removed and added; a
+     * link pointing elsewhere is changed.
+     */
+    vector<Change> merge_entries(size_t before_index, size_t after_index) const {
+        vector<size_t> first = sorted_entries(before, before_index);
+        vector<size_t> second = sorted_entries(after, after_index);
+        vector<Change> changes;
+        size_t i = 0, j = 0;
+        while (i < first.size() || j < second.size()) {
+            if (j == second.size()
+                || (i < first.size() && before.name(before.nodes()[first[i]])
+                    < after.name(after.nodes()[second[j]]))) {
+                changes.push_back({REMOVED, first[i++], 0});
+                continue;
+            }
+            if (i == first.size()
+                || after.name(after.nodes()[second[j]]) < before.name(before.nodes()[first[i]])) {
+                changes.push_back({ADDED, 0, second[j++]});
+                continue;
+            }
+            size_t a = first[i++], b = second[j++];
+            NodeKind kind = before.nodes()[a].kind;
+            if (kind != after.nodes()[b].kind) {
+                changes.push_back({REMOVED, a, 0});
+                changes.push_back({ADDED, 0, b});
+            } else if (kind == NodeKind::FILE) {
+                if (files_differ(a, b)) changes.push_back({CHANGED_ENTRY, a, b});
+            } else if (kind == NodeKind::LINK) {
+                if (before.target(before.nodes()[a]) != after.target(after.nodes()[b]))
+                    changes.push_back({CHANGED_ENTRY, a, b});
+            } else if (before_digests[a] != after_digests[b]) {
+                // Matching digests skip the whole subtree
+                changes.push_back({CHANGED_DIRECTORY, a, b});
+            }
+        }
+        return changes;
+    }
+
+    void write_marked(
+        string_view marker,
+        const DirectoryTree& tree,
+        size_t index,
+        unsigned int depth,
+        bool is_last
+    ) {
+        const Node& node = tree.nodes()[index];
+        marked_name.assign(marker);
+        marked_name.append(tree.name(node));
+        if (node.kind == NodeKind::LINK) {
+            emitter.write_link(marked_name, tree.target(node), depth, is_last, tree.metadata(index));
+        } else {
+            emitter.write_entry(marked_name, depth, node.kind == NodeKind::DIRECTORY, is_last,
+                tree.metadata(index));
+        }
+    }
+
+    const DirectoryTree& before;
+    const DirectoryTree& after;
+    unsigned int fields;
+    TreeEmitter& emitter;
+    vector<uint64_t> before_digests;
+    vector<uint64_t> after_digests;
+    string marked_name; ///< Name with its marker, reused.
+};
+
+}
+
+bool load_diff_tree(
+    const string& path,
+    const HierarchyOptions& options,
+    unsigned int thread_count,
+    DirectoryTree& tree
+) {
+    if (fs::is_directory(path)) {
+        HierarchyOptions walk_options = options;
+        walk_options.sort_entries = true;
+        walk_options.metadata_fields |= METADATA_SIZE | METADATA_MTIME;
+        tree = build_directory_tree(path, walk_options, thread_count);
+        return true;
+    }
+    if (!fs::is_regular_file(path)) {
+        cerr << "Error: " << path << " is neither a directory nor a dump." << endl;
+        return false;
+    }
+    DirectoryTreeBuilder builder(tree, METADATA_SIZE | METADATA_MTIME);
+    if (!render_binary_tree(path, builder)) return false;
+    const auto& nodes = tree.nodes();
+    if (nodes.empty() || nodes[0].kind != NodeKind::DIRECTORY
+        || nodes[0].subtree_end != nodes.size()) {
+        cerr << "Error: " << path << " is not the dump of a single directory." << endl;
+        return false;
+    }
+    return true;
+}
+
+TreeDiffCounts emit_tree_diff(
+    const DirectoryTree& before,
+    const DirectoryTree& after,
+    unsigned int compared_fields,
+    TreeEmitter& emitter
+) {
+    unsigned int fields = compared_fields & carried_fields(before) & carried_fields(after);
+    TreeDiffWriter writer(before, after, fields, emitter);
+    emitter.write_entry(after.name(after.nodes()[0]), 0, true, true, nullptr);
+    if (writer.roots_differ())
+        writer.diff_directories(0, 0, 0);
+    return writer.counts;
+}
+
+/**
+ * @brief Prints the closing line with the counts of a diff.
+ */
+void write_diff_summary(const TreeDiffCounts& counts, OutputBuffer& output) {
+    output.write("\n" + std::to_string(counts.added) + " added, "
+        + std::to_string(counts.removed) + " removed, "
+        + std::to_string(counts.changed) + " changed\n");
+}
@@ -0,0 +1,73 @@
+#include "../include/tree_emitter.hpp"
+#include "../include/binary_format.hpp"
+#include "../include/disk_usage.hpp"
+#include "../include/hierarchy.hpp"
+#include "../include/json_emitter.hpp"
+#include "../include/stats_emitter.hpp"
+#include "../include/top_entries.hpp"
+#include "../include/tree_renderer.hpp"
+
+void TreeEmitter::write_link(
+    std::string_view name,
+    std::string_view target,
+    unsigned int depth,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    std::string line(name);
+    line += " -> ";
+    line += target;
+    write_entry(line, depth, false, is_last, metadata);
+}
+
+/**
+ * @brief Creates the emitter of one output format.
+ */
+static std::unique_ptr<TreeEmitter> make_format_emitter(
+    OutputFormat format,
+    OutputBuffer& output,
+    const HierarchyOptions& options
+) {
+    switch (format) {
+        case OutputFormat::JSON:
+            return std::make_unique<JsonEmitter>(output, options.columns);
+        case OutputFormat::NDJSON:
+            return std::make_unique<NdjsonEmitter>(output, options.columns);
+        case OutputFormat::BINARY:
+            return std::make_unique<BinaryEmitter>(output);
+        case OutputFormat::TEXT:
+            break;
+    }
+    return std::make_unique<TreeRenderer>(
+        output, options.x_spacing, options.y_spacing, options.columns, options.charset
+    );
+}
+
+/**
+ * @brief Creates the emitter writing a format into an output buffer.
+ *
+ * With --du, the format's emitter is fed through a DiskUsageEmitter, and
+ * with --top through a TopEntriesEmitter. --stats measures in front of
+ * all of them.
+ *
+ * @param format The output format.
+ * @param output The buffer receiving the output.
+ * @param options The spacing, column and --du settings of the current run.
+ * @return The emitter.
+ */
+std::unique_ptr<TreeEmitter> make_tree_emitter(
+    OutputFormat format,
+    OutputBuffer& output,
+    const HierarchyOptions& options
+) {
+    std::unique_ptr<TreeEmitter> emitter = make_format_emitter(format, output, options);
+    if (options.disk_usage)
+        emitter = std::make_unique<DiskUsageEmitter>(std::move(emitter), options.max_depth);
+    if (options.top_entries)
+        emitter = std::make_unique<TopEntriesEmitter>(
+            std::move(emitter), options.top_entries, options.top_field
+        );
+    if (options.stats)
+        emitter = std::make_unique<StatsEmitter>(std::move(emitter), *options.stats);
+    return emitter;
+}
@@ -0,0 +1,233 @@
+#include "../include/tree_renderer.hpp"
+#include <climits>
+#include <cstdio>
+#include <ctime>
+
+using std::string;
+using std::string_view;
+
+/**
+ * @brief Generates a repeated character string.
+ *
+ * @param n The number of times to repeat the string.
+ * @param s The string to repeat.
+ * @return The concatenated string.
+ */
+string generate_character_string(unsigned int n, string s) {
+	string result;
+	result.reserve(n * s.length());
+	for (unsigned int i = 0; i < n; ++i)
+		result += s;
+	return result;
+}
+
+/**
+ * @brief Creates a renderer whose root level has no connector.
+ *
+ * @param output The buffer receiving the lines.
+ * @param x_spacing The number of spaces for horizontal padding.
+ * @param y_spacing The number of lines for vertical padding.
+ * @param columns The MetadataField bits shown before each name.
+ * @param charset The characters the tree is drawn with.
+ */
+TreeRenderer::TreeRenderer(
+    OutputBuffer& output,
+    unsigned int x_spacing,
+    unsigned int y_spacing,
+    unsigned int columns,
+    Charset charset
+) : sink(output),
+    y_spacing(y_spacing),
+    columns(columns),
+    level_states{NO_VALUE} {
+    if (charset == Charset::ASCII)
+        build_fragments<Charset::ASCII>(x_spacing);
+    else
+        build_fragments<Charset::UTF8>(x_spacing);
+    switch (y_spacing) {
+        case 0:
+            line_writer = &TreeRenderer::write_connected_line<0>;
+            break;
+        case 1:
+            line_writer = &TreeRenderer::write_connected_line<1>;
+            break;
+        default:
+            line_writer = &TreeRenderer::write_connected_line<UINT_MAX>;
+            break;
+    }
+}
+
+/**
+ * @brief Builds the connectors and prefix segments of a charset.
+ *
+ * @param x_spacing The number of horizontal characters after each connector.
+ */
+template <Charset charset>
+void TreeRenderer::build_fragments(unsigned int x_spacing) {
+    using Glyphs = TreeGlyphs<charset>;
+    string horizontal = generate_character_string(x_spacing, string(Glyphs::horizontal));
+    connectors[NOT_ITERATING] = string(Glyphs::last) + horizontal;
+    connectors[ITERATING] = string(Glyphs::branch) + horizontal;
+    segments[NOT_ITERATING] = string(1 + x_spacing, ' ');
+    segments[ITERATING] = string(Glyphs::vertical) + string(x_spacing, ' ');
+    vertical = Glyphs::vertical;
+    ellipsis = Glyphs::ellipsis;
+}
+
+void TreeRenderer::set_level_state(unsigned int depth, LevelState state) {
+    if (depth >= level_states.size())
+        level_states.resize(depth + 1, NOT_ITERATING);
+    level_states[depth] = state;
+}
+
+void TreeRenderer::begin_entries(unsigned int depth) {
+    // The root level has no connector and therefore no segment
+    if (depth == 0 || level_states[depth] == NO_VALUE) {
+        segment_lengths.push_back(0);
+        return;
+    }
+    const string& segment = segments[level_states[depth]];
+    prefix += segment;
+    segment_lengths.push_back(segment.size());
+}
+
+void TreeRenderer::end_entries() {
+    prefix.resize(prefix.size() - segment_lengths.back());
+    segment_lengths.pop_back();
+}
+
+void TreeRenderer::write_entry(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    bool is_last,
+    const EntryMetadata* metadata
+) {
+    // The root level keeps NO_VALUE and never gets a connector
+    if (depth > 0)
+        set_level_state(depth, is_last ? NOT_ITERATING : ITERATING);
+    write_line(name, depth, is_directory, metadata);
+}
+
+void TreeRenderer::write_omitted(size_t omitted_count, unsigned int depth) {
+    set_level_state(depth, NOT_ITERATING);
+    write_line(string(ellipsis) + " (" + std::to_string(omitted_count) + " more)",
+        depth, false, nullptr);
+}
+
+void TreeRenderer::write_summary(unsigned int directory_count, unsigned int file_count) {
+    sink.write("\n" + std::to_string(directory_count)
+        + (directory_count == 1 ? " directory, " : " directories, ")
+        + std::to_string(file_count)
+        + (file_count == 1 ? " file\n" : " files\n"));
+}
+
+/**
+ * @brief Formats the selected columns of an entry into column_text.
+ *
+ * Sizes are right-aligned, owners left-aligned, and times use the local
+ * time zone; fields that could not be read show as '?'.
+ */
+void TreeRenderer::format_columns(const EntryMetadata* metadata) {
+    column_text.assign(" [");
+    unsigned int fields = metadata ? metadata->fields : 0;
+    bool first = true;
+    auto separate = [&] {
+        if (!first) column_text += ' ';
+        first = false;
+    };
+    char buffer[32];
+    if (columns & METADATA_SIZE) {
+        separate();
+        if (fields & METADATA_SIZE) {
+            std::snprintf(buffer, sizeof(buffer), "%11llu",
+                static_cast<unsigned long long>(metadata->size));
+        } else {
+            std::snprintf(buffer, sizeof(buffer), "%11s", "?");
+        }
+        column_text += buffer;
+    }
+    if (columns & METADATA_MTIME) {
+        separate();
+        std::time_t seconds = (fields & METADATA_MTIME) ? mtime_seconds(*metadata) : 0;
+        std::tm local;
+        if ((fields & METADATA_MTIME) && localtime_r(&seconds, &local)
+            && std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M", &local)) {
+            column_text += buffer;
+        } else {
+            column_text += "               ?";
+        }
+    }
+    if (columns & METADATA_OWNER) {
+        separate();
+        size_t start = column_text.size();
+        column_text += (fields & METADATA_OWNER) ? owners.lookup(metadata->owner) : "?";
+        if (column_text.size() - start < 8)
+            column_text.append(8 - (column_text.size() - start), ' ');
+    }
+    column_text += "]  ";
+}
+
+/**
+ * @brief Writes the prefix, connector, columns and name of a line at a depth.
+ */
+void TreeRenderer::write_line(
+    string_view name,
+    unsigned int depth,
+    bool is_directory,
+    const EntryMetadata* metadata
+) {
+    if (depth >= level_states.size() || level_states[depth] == NO_VALUE) {
+        write_root_line(name, is_directory, metadata);
+        return;
+    }
+    (this->*line_writer)(name, is_directory, level_states[depth], metadata);
+}
+
+/**
+ * @brief Writes the line of the root, which has no prefix or connector.
+ */
+void TreeRenderer::write_root_line(
+    string_view name,
+    bool is_directory,
+    const EntryMetadata* metadata
+) {
+    // Only --du gives the root metadata: its total
+    if (columns && metadata) {
+        format_columns(metadata);
+        sink.write(string_view(column_text).substr(1));
+    }
+    sink.write(name);
+    sink.write_line(is_directory && (name.empty() || name.back() != '/') ? "/" : "");
+}
+
+/**
+ * @brief Writes the padding lines and the line of an entry below the root.
+ *
+ * @tparam padding_lines The y-spacing, or UINT_MAX to read it at run time.
+ * @param state The iteration state picking the entry's connector.
+ */
+template <unsigned int padding_lines>
+void TreeRenderer::write_connected_line(
+    string_view name,
+    bool is_directory,
+    LevelState state,
+    const EntryMetadata* metadata
+) {
+    unsigned int padding = (padding_lines == UINT_MAX) ? y_spacing : padding_lines;
+    // Vertical padding
+    for (unsigned int y = 0; y < padding; y++) {
+        sink.write(prefix);
+        sink.write_line(vertical);
+    }
+    // Horizontal padding, hierarchy symbol and name
+    sink.write(prefix);
+    sink.write(connectors[state]);
+    if (columns && metadata) {
+        format_columns(metadata);
+        sink.write(column_text);
+    }
+    sink.write(name);
+    bool needs_slash = is_directory && (name.empty() || name.back() != '/');
+    sink.write_line(string_view("/", needs_slash));
+}
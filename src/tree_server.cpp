@@ -0,0 +1,442 @@
+#include "../include/tree_server.hpp"
+#include "../include/watch.hpp"
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::string_view;
+
+namespace fs = std::filesystem;
+
+#ifdef __linux__
+
+namespace {
+
+// First line of every request, so other clients are told apart.
+constexpr string_view PROTOCOL_LINE = "LSTREE1";
+
+// Requests are a few short lines; anything longer is refused.
+constexpr size_t MAX_REQUEST_SIZE = 64 * 1024;
+
+// A client that takes longer to send its request, or stops reading its
+// reply for this long, is dropped; the clients after it wait meanwhile.
+constexpr int SOCKET_TIMEOUT_MS = 5000;
+
+// Queued events are applied once none arrived for this long, so most
+// requests find the tree already current.
+constexpr int REFRESH_DELAY_MS = 100;
+
+// Names of the formats on the wire, in OutputFormat order.
+constexpr string_view FORMAT_NAMES[] = {"text", "json", "ndjson", "bin"};
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+    stop_requested = 1;
+}
+
+/**
+ * @brief Fills in the address of a socket path.
+ *
+ * @return false, after printing an error, if the path does not fit.
+ */
+bool make_socket_address(const string& socket_path, sockaddr_un& address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        cerr << "Error: the socket path " << socket_path << " is empty or too long." << endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.data(), socket_path.size());
+    return true;
+}
+
+void set_socket_timeouts(int fd) {
+    timeval timeout = {SOCKET_TIMEOUT_MS / 1000, (SOCKET_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * @brief Binds and listens on a socket path.
+ *
+ * A socket left behind by a daemon that died is replaced; one that still
+ * accepts connections, or a file that is no socket, is not.
+ *
+ * @return The listening descriptor, or -1 after printing an error.
+ */
+int open_listener(const string& socket_path, const sockaddr_un& address) {
+    const sockaddr* socket_address = reinterpret_cast<const sockaddr*>(&address);
+    struct stat existing;
+    if (lstat(socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            cerr << "Error: " << socket_path << " exists and is not a socket." << endl;
+            return -1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, socket_address, sizeof(address)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            cerr << "Error: a daemon is already serving on " << socket_path << "." << endl;
+            return -1;
+        }
+        unlink(socket_path.c_str());
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, socket_address, sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0) {
+        cerr << "Error: cannot listen on " << socket_path << ": " << std::strerror(errno) << endl;
+        if (listener >= 0) close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+/**
+ * @brief Reads a request up to the blank line that ends it.
+ *
+ * The whole request must arrive within SOCKET_TIMEOUT_MS, so a client
+ * sending it a byte at a time cannot hold the daemon any longer.
+ *
+ * @return false if the client closed, timed out or sent too much first.
+ */
+bool read_request(int fd, string& text) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(SOCKET_TIMEOUT_MS);
+    char buffer[4096];
+    while (text.find("\n\n") == string::npos) {
+        if (text.size() > MAX_REQUEST_SIZE) return false;
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - Clock::now()
+        ).count();
+        pollfd descriptor = {fd, POLLIN, 0};
+        int ready = remaining > 0 ? poll(&descriptor, 1, static_cast<int>(remaining)) : 0;
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return false;
+        ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) return false;
+        text.append(buffer, bytes_read);
+    }
+    text.resize(text.find("\n\n") + 1);
+    return true;
+}
+
+bool parse_number(string_view text, unsigned int& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+/**
+ * @brief Parses the "key value" lines of a request.
+ *
+ * @param error Receives the reason a request is refused.
+ */
+bool parse_request(string_view text, TreeRequest& request, string& error) {
+    bool first_line = true;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        string_view line = text.substr(0, end);
+        text.remove_prefix(end + 1);
+        if (first_line) {
+            first_line = false;
+            if (line != PROTOCOL_LINE) {
+                error = "unsupported protocol";
+                return false;
+            }
+            continue;
+        }
+        size_t separator = line.find(' ');
+        string_view key = line.substr(0, separator);
+        string_view value = (separator == string_view::npos) ? string_view() : line.substr(separator + 1);
+        bool valid = true;
+        if (key == "path") {
+            request.path = string(value);
+        } else if (key == "name") {
+            request.name = string(value);
+        } else if (key == "format") {
+            valid = false;
+            for (size_t i = 0; i < std::size(FORMAT_NAMES); i++) {
+                if (value == FORMAT_NAMES[i]) {
+                    request.format = static_cast<OutputFormat>(i);
+                    valid = true;
+                }
+            }
+        } else if (key == "charset") {
+            valid = value == "utf8" || value == "ascii";
+            request.charset = (value == "ascii") ? Charset::ASCII : Charset::UTF8;
+        } else if (key == "columns") {
+            valid = parse_number(value, request.columns)
+                && (request.columns & ~(METADATA_SIZE | METADATA_MTIME | METADATA_OWNER)) == 0;
+        } else if (key == "depth") {
+            valid = parse_number(value, request.max_depth);
+        } else if (key == "x") {
+            valid = parse_number(value, request.x_spacing);
+        } else if (key == "y") {
+            valid = parse_number(value, request.y_spacing);
+        }
+        // Unknown keys are skipped, so newer clients still work
+        if (!valid) {
+            error = "invalid " + string(key) + " '" + string(value) + "'";
+            return false;
+        }
+    }
+    if (request.path.empty()) {
+        error = "no path requested";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @class FieldMaskEmitter
+ * @brief Hands an emitter only the metadata fields it asked for.
+ *
+ * The served listings carry every field any request can show, while
+ * emitters print whatever fields an entry comes with.
+ */
+class FieldMaskEmitter : public TreeEmitter {
+public:
+    explicit FieldMaskEmitter(std::unique_ptr<TreeEmitter> inner)
+        : inner(std::move(inner)), fields(this->inner->metadata_fields()) {}
+
+    void write_entry(
+        string_view name,
+        unsigned int depth,
+        bool is_directory,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override {
+        inner->write_entry(name, depth, is_directory, is_last, mask(metadata));
+    }
+
+    void write_link(
+        string_view name,
+        string_view target,
+        unsigned int depth,
+        bool is_last,
+        const EntryMetadata* metadata
+    ) override {
+        inner->write_link(name, target, depth, is_last, mask(metadata));
+    }
+
+    void begin_entries(unsigned int depth) override { inner->begin_entries(depth); }
+    void end_entries() override { inner->end_entries(); }
+
+    void write_omitted(size_t omitted_count, unsigned int depth) override {
+        inner->write_omitted(omitted_count, depth);
+    }
+
+    void write_summary(unsigned int directory_count, unsigned int file_count) override {
+        inner->write_summary(directory_count, file_count);
+    }
+
+    unsigned int metadata_fields() const override { return fields; }
+
+private:
+    const EntryMetadata* mask(const EntryMetadata* metadata) {
+        if (!metadata || !fields) return nullptr;
+        masked = *metadata;
+        masked.fields &= fields;
+        return &masked;
+    }
+
+    std::unique_ptr<TreeEmitter> inner;
+    unsigned int fields;
+    EntryMetadata masked; ///< The entry being forwarded, reused.
+};
+
+/**
+ * @brief Answers one request from the tree in memory.
+ */
+void answer_request(int client, const TreeWatcher& watcher, const string& root) {
+    set_socket_timeouts(client);
+    OutputBuffer reply(client);
+    string text, error;
+    TreeRequest request;
+    if (!read_request(client, text)) {
+        reply.write("ERR incomplete request\n");
+        return;
+    }
+    if (!parse_request(text, request, error)) {
+        reply.write("ERR " + error + "\n");
+        return;
+    }
+    // Clients speak the protocol directly too, so the path is resolved here
+    // rather than trusted to be canonical like the root
+    std::error_code resolve_error;
+    fs::path requested = fs::weakly_canonical(request.path, resolve_error);
+    if (resolve_error) requested = fs::path(request.path).lexically_normal();
+    fs::path relative = requested.lexically_relative(root);
+    const WatchedDirectory* directory = nullptr;
+    if (!relative.empty() && *relative.begin() != "..")
+        directory = watcher.find(relative.generic_string());
+    if (!directory) {
+        reply.write("ERR " + request.path + " is not a directory served from " + root + "\n");
+        return;
+    }
+    // Only rendering settings differ between requests
+    HierarchyOptions render_options;
+    render_options.x_spacing = request.x_spacing;
+    render_options.y_spacing = request.y_spacing;
+    render_options.charset = request.charset;
+    render_options.columns = request.columns;
+    render_options.max_depth = request.max_depth;
+    reply.write("OK\n");
+    FieldMaskEmitter emitter(make_tree_emitter(request.format, reply, render_options));
+    HierarchyState state(emitter);
+    state.directory_count = 1;
+    print_directory_header(request.name.empty() ? request.path : request.name, state, 0);
+    watcher.render_entries(*directory, render_options, state, 0);
+    print_summary(state);
+}
+
+}
+
+#endif
+
+int serve_directory_hierarchy(
+    const string& socket_path,
+    const string& path,
+    const HierarchyOptions& options
+) {
+#ifdef __linux__
+    std::error_code error;
+    string root = fs::canonical(path, error).string();
+    if (error || !fs::is_directory(root)) {
+        cerr << "Error: " << path << " is not a directory." << endl;
+        return 1;
+    }
+    sockaddr_un address;
+    if (!make_socket_address(socket_path, address)) return 1;
+    TreeWatcher watcher(options);
+    if (!watcher.start(root)) return 1;
+    int listener = open_listener(socket_path, address);
+    if (listener < 0) return 1;
+    // Clients that hang up mid-reply must not end the daemon
+    std::signal(SIGPIPE, SIG_IGN);
+    struct sigaction stop = {};
+    stop.sa_handler = request_stop;
+    sigaction(SIGINT, &stop, nullptr);
+    sigaction(SIGTERM, &stop, nullptr);
+    int status = 0;
+    while (!stop_requested) {
+        pollfd descriptors[2] = {{watcher.descriptor(), POLLIN, 0}, {listener, POLLIN, 0}};
+        int ready = poll(descriptors, 2, watcher.has_changes() ? REFRESH_DELAY_MS : -1);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) break;
+        // Events are already queued once the calls making a change return,
+        // so a client always sees the changes it made itself. Clients are
+        // answered one at a time on this thread: one that stalls holds up the
+        // others and the event queue until it is dropped after SOCKET_TIMEOUT_MS
+        if (!watcher.read_events()) {
+            cerr << "Error: " << path << " was removed or moved." << endl;
+            status = 1;
+            break;
+        }
+        if (ready == 0 || (descriptors[1].revents & POLLIN)) watcher.apply_changes();
+        if (!(descriptors[1].revents & POLLIN)) continue;
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        answer_request(client, watcher, root);
+        close(client);
+    }
+    close(listener);
+    unlink(socket_path.c_str());
+    return status;
+#else
+    (void)socket_path;
+    (void)path;
+    (void)options;
+    cerr << "Error: --serve is not supported on this platform." << endl;
+    return 1;
+#endif
+}
+
+int request_directory_hierarchy(
+    const string& socket_path,
+    const TreeRequest& request,
+    OutputBuffer& output
+) {
+#ifdef __linux__
+    if (request.path.find('\n') != string::npos || request.name.find('\n') != string::npos) {
+        cerr << "Error: paths with line breaks cannot be requested." << endl;
+        return 1;
+    }
+    sockaddr_un address;
+    if (!make_socket_address(socket_path, address)) return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        cerr << "Error: cannot reach a daemon on " << socket_path << ": "
+            << std::strerror(errno) << endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    {
+        OutputBuffer sent(fd);
+        sent.write(string(PROTOCOL_LINE) + "\n");
+        sent.write("format " + string(FORMAT_NAMES[static_cast<size_t>(request.format)]) + "\n");
+        sent.write("columns " + std::to_string(request.columns) + "\n");
+        sent.write("depth " + std::to_string(request.max_depth) + "\n");
+        sent.write("x " + std::to_string(request.x_spacing) + "\n");
+        sent.write("y " + std::to_string(request.y_spacing) + "\n");
+        sent.write(string("charset ") + (request.charset == Charset::ASCII ? "ascii" : "utf8") + "\n");
+        sent.write("path " + request.path + "\n");
+        sent.write("name " + request.name + "\n\n");
+    }
+    // The status line, then the tree as the daemon writes it
+    string status;
+    bool answered = false;
+    char buffer[64 * 1024];
+    while (true) {
+        ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) break;
+        string_view chunk(buffer, bytes_read);
+        if (!answered) {
+            size_t end = chunk.find('\n');
+            status.append(chunk.substr(0, end));
+            if (end == string_view::npos) continue;
+            answered = true;
+            chunk.remove_prefix(end + 1);
+            if (status != "OK") break;
+        }
+        output.write(chunk);
+    }
+    close(fd);
+    if (!answered) {
+        cerr << "Error: the daemon on " << socket_path << " closed the connection." << endl;
+        return 1;
+    }
+    if (status != "OK") {
+        string_view message = status;
+        if (message.substr(0, 4) == "ERR ") message.remove_prefix(4);
+        cerr << "Error: " << message << endl;
+        return 1;
+    }
+    return 0;
+#else
+    (void)socket_path;
+    (void)request;
+    (void)output;
+    cerr << "Error: --client is not supported on this platform." << endl;
+    return 1;
+#endif
+}
@@ -0,0 +1,233 @@
+#include "../include/uring_walker.hpp"
+#include "../include/directory_task.hpp"
+#include "../include/io_uring_queue.hpp"
+#include "../include/run_stats.hpp"
+#include <algorithm>
+#include <deque>
+#include <memory>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using std::deque;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+#ifdef __linux__
+
+namespace {
+
+// Submission slots of the open queue.
+static constexpr unsigned int QUEUE_DEPTH = 64;
+// Directories opened ahead of the printer at most; bounds open descriptors.
+static constexpr size_t MAX_OUTSTANDING = 256;
+
+/**
+ * @brief How many directories may be opened ahead of the printer.
+ *
+ * Each one holds a descriptor until it is read. They get half of
+ * open_directory_limit(); the other half is the DescriptorBudget of the
+ * parents kept open until all of their subdirectories are.
+ */
+static size_t outstanding_limit() {
+    return std::clamp<size_t>(open_directory_limit() / 2, 1, MAX_OUTSTANDING);
+}
+
+/**
+ * @enum TaskStatus
+ * @brief Lifecycle of a directory read.
+ */
+enum TaskStatus {
+    QUEUED,    ///< Waiting in the open queue.
+    SUBMITTED, ///< Its open is in flight.
+    OPENED,    ///< Open completed; waiting in the ready queue.
+    DONE       ///< Listing (or error) is available.
+};
+
+/**
+ * @class UringWalker
+ * @brief Opens directories through io_uring and prints them in order.
+ *
+ * Everything runs on the calling thread: while the printer waits for a
+ * directory, queued opens are submitted in one batch and the completions
+ * are read as they arrive, which queues the opens of their subdirectories.
+ */
+class UringWalker {
+public:
+    UringWalker(const HierarchyOptions& options, HierarchyState& state, IoUring& queue)
+        : options(options), state(state), queue(queue), max_outstanding(outstanding_limit()),
+          budget(std::make_shared<DescriptorBudget>(open_directory_limit() - max_outstanding)) {}
+
+    /**
+     * @brief Waits for the opens still in flight and closes what they opened.
+     *
+     * Only matters when printing stopped early on an error; the kernel
+     * must be done with the names before their tasks go away.
+     */
+    ~UringWalker() {
+        while (in_flight > 0 && queue.submit_and_wait(1)) {
+            io_uring_cqe completion;
+            while (queue.pop_completion(completion)) {
+                if (completion.res >= 0) close(completion.res);
+                in_flight--;
+            }
+        }
+    }
+
+    /**
+     * @brief Prints the entries of a task's subtree, waiting for reads as needed.
+     */
+    void render(const shared_ptr<DirectoryTask>& root, unsigned int depth) {
+        render_directory_task(root, depth, options, state,
+            [this](DirectoryTask& task) { wait_for(task); },
+            [this] { outstanding--; });
+    }
+
+private:
+    /**
+     * @brief Reads directories until a task is done, submitting its open first.
+     */
+    void wait_for(DirectoryTask& task) {
+        while (task.status != DONE) {
+            if (task.status == OPENED) {
+                read(task);
+            } else if (task.status == QUEUED && in_flight + batch.size() < queue.capacity()) {
+                // The printer needs it now; it jumps the open queue
+                prepare_open(task);
+            } else {
+                pump();
+            }
+        }
+    }
+
+    /**
+     * @brief Adds the open of a task to the next batch.
+     */
+    void prepare_open(DirectoryTask& task) {
+        outstanding++;
+        if (task.parent_directory->fd < 0) {
+            // Detached past the budget; read() opens it by path instead
+            task.status = OPENED;
+            ready.push_back(&task);
+            return;
+        }
+        io_uring_sqe* request = queue.next_submission();
+        request->opcode = IORING_OP_OPENAT;
+        request->fd = task.parent_directory->fd;
+        request->addr = reinterpret_cast<uint64_t>(task.name.c_str());
+        request->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+        request->user_data = reinterpret_cast<uint64_t>(&task);
+        task.status = SUBMITTED;
+        count_stat(STATS_OPENDIR);
+        batch.push_back(&task);
+    }
+
+    /**
+     * @brief Submits the queued opens, then reads every directory that opened.
+     */
+    void pump() {
+        while (!open_queue.empty() && in_flight + batch.size() < queue.capacity()
+            && outstanding < max_outstanding) {
+            shared_ptr<DirectoryTask> task = std::move(open_queue.front());
+            open_queue.pop_front();
+            // Skip tasks that jumped the queue or are no longer needed
+            if (task->status == QUEUED && task.use_count() > 1)
+                prepare_open(*task);
+        }
+        if (!batch.empty() || in_flight > 0) {
+            unsigned int submitted = batch.size();
+            if (queue.submit_and_wait(1)) {
+                in_flight += submitted;
+            } else {
+                // The kernel took none of them; open them the blocking way
+                for (DirectoryTask* task : batch) {
+                    task->open_result = -1;
+                    task->status = OPENED;
+                    ready.push_back(task);
+                }
+            }
+            batch.clear();
+        }
+        io_uring_cqe completion;
+        while (queue.pop_completion(completion)) {
+            auto* task = reinterpret_cast<DirectoryTask*>(completion.user_data);
+            task->open_result = completion.res;
+            task->status = OPENED;
+            ready.push_back(task);
+            in_flight--;
+        }
+        while (!ready.empty()) {
+            DirectoryTask* task = ready.front();
+            ready.pop_front();
+            if (task->status == OPENED) read(*task);
+        }
+    }
+
+    /**
+     * @brief Reads an opened directory and queues the opens of its subdirectories.
+     */
+    void read(DirectoryTask& task) {
+        read_directory_task(task, options, [](const DirectoryTask& subdirectory) {
+            // A failed open is retried the blocking way, which reports it
+            return subdirectory.open_result >= 0
+                ? OpenDirectory("", subdirectory.open_result)
+                : open_subdirectory(
+                    *subdirectory.parent_directory, subdirectory.name, ReadBackend::GETDENTS
+                );
+        }, budget);
+        // Open depth-first, in print order, ahead of everything queued before
+        for (auto it = task.subdirectories.rbegin(); it != task.subdirectories.rend(); ++it)
+            open_queue.push_front(*it);
+        task.status = DONE;
+    }
+
+    const HierarchyOptions& options;
+    HierarchyState& state;
+    IoUring& queue;
+    size_t max_outstanding;
+    shared_ptr<DescriptorBudget> budget;
+    deque<shared_ptr<DirectoryTask>> open_queue; ///< Subdirectories not yet submitted.
+    vector<DirectoryTask*> batch;                ///< Opens of the next submission.
+    deque<DirectoryTask*> ready;                 ///< Opened, not yet read.
+    unsigned int in_flight = 0;                  ///< Opens submitted but not completed.
+    size_t outstanding = 0;                      ///< Tasks submitted but not yet printed.
+};
+
+}
+
+bool generate_directory_hierarchy_uring(
+    string& path,
+    const HierarchyOptions& options,
+    HierarchyState& state
+) {
+    IoUring queue(QUEUE_DEPTH);
+    if (!queue.ready()) return false;
+    // Opens are relative to the parent descriptor, which only getdents keeps
+    HierarchyOptions engine_options = options;
+    engine_options.backend = ReadBackend::GETDENTS;
+    // Validate the path
+    if (!path_is_valid(path, state, 0)) return true;
+    auto root = make_shared<DirectoryTask>(path, nullptr, 0);
+    root->directory = make_shared<OpenDirectory>(
+        open_root_directory(path, engine_options.backend)
+    );
+    if (engine_options.use_gitignore)
+        root->gitignore = GitignoreScope::open_root(*root->directory);
+    root->status = OPENED;
+    UringWalker walker(engine_options, state, queue);
+    print_directory_header(path, state, 0);
+    walker.render(root, 0);
+    return true;
+}
+
+#else
+
+bool generate_directory_hierarchy_uring(string&, const HierarchyOptions&, HierarchyState&) {
+    return false;
+}
+
+#endif
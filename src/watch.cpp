@@ -0,0 +1,378 @@
+#include "../include/watch.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::endl;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+using std::unordered_map;
+using std::unordered_set;
+using std::vector;
+
+#ifdef __linux__
+
+namespace {
+
+// Events are coalesced until none arrived for this long...
+constexpr int QUIET_PERIOD_MS = 100;
+// ...but a steady stream of events still refreshes this often.
+constexpr int MAX_BATCH_MS = 1000;
+
+// Changes to the entries of a watched directory, or to the directory itself.
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+    | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+// Owner, mode and time changes, watched as well when columns show them.
+constexpr uint32_t METADATA_WATCH_MASK = IN_ATTRIB;
+
+}
+
+/**
+ * @brief Tears a subtree down one directory at a time instead of one call per level.
+ */
+WatchedDirectory::~WatchedDirectory() {
+    vector<unique_ptr<WatchedDirectory>> dropped = std::move(subdirectories);
+    while (!dropped.empty()) {
+        unique_ptr<WatchedDirectory> directory = std::move(dropped.back());
+        dropped.pop_back();
+        // Slots past the depth limit are empty, and so are those moved out
+        // below, which the popped directory's own destructor walks again
+        if (!directory) continue;
+        for (auto& subdirectory : directory->subdirectories)
+            if (subdirectory) dropped.push_back(std::move(subdirectory));
+    }
+}
+
+/**
+ * @brief Starts watching a directory that is about to be read.
+ *
+ * A subdirectory that cannot be watched, e.g. once fs.inotify.max_user_watches
+ * is used up, is still shown, with a warning that it will not be updated.
+ */
+void TreeWatcher::watch(WatchedDirectory& directory) {
+    uint32_t mask = WATCH_MASK | (options.metadata_fields ? METADATA_WATCH_MASK : 0);
+    directory.watch = inotify_add_watch(inotify_fd, directory.path.c_str(), mask);
+    if (directory.watch < 0) {
+        // start() reports the root itself
+        if (directory.parent)
+            cerr << "Warning: cannot watch " << directory.path << ": " << std::strerror(errno)
+                << "; changes below it are not shown." << endl;
+        return;
+    }
+    // The same directory reached twice (through a symlink) reports to the first
+    if (!watched.count(directory.watch))
+        watched[directory.watch] = &directory;
+}
+
+/**
+ * @brief Reads a directory again, keeping the subtrees of unchanged subdirectories.
+ *
+ * New subdirectories are watched and read as well. They are queued rather
+ * than loaded recursively, so the depth of the tree is not limited by the
+ * call stack.
+ *
+ * @param directory The directory named by an event.
+ * @param reload_subtree Whether to read every subdirectory again as well,
+ * as needed when .gitignore rules above them changed.
+ */
+void TreeWatcher::refresh(WatchedDirectory& directory, bool reload_subtree) {
+    vector<std::pair<WatchedDirectory*, bool>> pending = {{&directory, reload_subtree}};
+    while (!pending.empty()) {
+        auto [next, reload] = pending.back();
+        pending.pop_back();
+        refresh_listing(*next, reload, pending);
+    }
+}
+
+/**
+ * @brief Reads one directory again and reconciles its subdirectories.
+ *
+ * @param pending Receives the new subdirectories, which still have to be read.
+ */
+void TreeWatcher::refresh_listing(
+    WatchedDirectory& directory,
+    bool reload_subtree,
+    vector<std::pair<WatchedDirectory*, bool>>& pending
+) {
+    DirectoryListing listing;
+    try {
+        OpenDirectory open = open_root_directory(directory.path, options.backend);
+        if (!directory.parent) {
+            if (options.use_gitignore)
+                directory.gitignore = GitignoreScope::open_root(open);
+        } else if (directory.parent->gitignore) {
+            directory.gitignore = GitignoreScope::open_subdirectory(
+                directory.parent->gitignore, open, directory.name
+            );
+        }
+        listing = read_directory_listing(open, options, directory.gitignore.get());
+    } catch (const std::filesystem::filesystem_error&) {
+        // Gone or unreadable; the parent's event removes it from the tree
+    }
+    unordered_set<string_view> listed_names;
+    for (const auto& entry : listing.entries)
+        if (entry.is_directory()) listed_names.insert(entry.name);
+    // Drop vanished subtrees before loading new ones: a renamed directory
+    // keeps its inode, and with it its watch descriptor
+    unordered_map<string, unique_ptr<WatchedDirectory>> kept;
+    for (auto& subdirectory : directory.subdirectories) {
+        if (!subdirectory) continue;
+        if (reload_subtree || !listed_names.count(subdirectory->name)) {
+            release(*subdirectory);
+        } else {
+            string name = subdirectory->name;
+            kept.emplace(std::move(name), std::move(subdirectory));
+        }
+    }
+    directory.subdirectories.clear();
+    directory.listing = std::move(listing);
+    for (const auto& entry : directory.listing.entries) {
+        if (!entry.is_directory()) continue;
+        unique_ptr<WatchedDirectory> subdirectory;
+        if (lists_entries_at(options, directory.depth + 1)) {
+            auto previous = kept.find(string(entry.name));
+            if (previous != kept.end()) {
+                subdirectory = std::move(previous->second);
+            } else {
+                subdirectory = std::make_unique<WatchedDirectory>();
+                subdirectory->parent = &directory;
+                subdirectory->path = directory.path;
+                if (subdirectory->path.back() != '/')
+                    subdirectory->path += '/';
+                subdirectory->path += entry.name;
+                subdirectory->name = string(entry.name);
+                subdirectory->depth = directory.depth + 1;
+                watch(*subdirectory);
+                pending.emplace_back(subdirectory.get(), true);
+            }
+        }
+        directory.subdirectories.push_back(std::move(subdirectory));
+    }
+}
+
+/**
+ * @brief Stops watching a subtree that is about to be dropped.
+ */
+void TreeWatcher::release(WatchedDirectory& top) {
+    vector<WatchedDirectory*> stack = {&top};
+    while (!stack.empty()) {
+        WatchedDirectory& directory = *stack.back();
+        stack.pop_back();
+        for (auto& subdirectory : directory.subdirectories)
+            if (subdirectory) stack.push_back(subdirectory.get());
+        auto entry = watched.find(directory.watch);
+        if (entry != watched.end() && entry->second == &directory) {
+            inotify_rm_watch(inotify_fd, directory.watch);
+            watched.erase(entry);
+        }
+    }
+}
+
+TreeWatcher::~TreeWatcher() {
+    if (inotify_fd >= 0) close(inotify_fd);
+}
+
+bool TreeWatcher::start(const string& path) {
+    inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        cerr << "Error: cannot start watching: " << std::strerror(errno) << endl;
+        return false;
+    }
+    root = std::make_unique<WatchedDirectory>();
+    root->path = path;
+    root->name = path;
+    watch(*root);
+    if (root->watch < 0) {
+        cerr << "Error: cannot watch " << path << ": " << std::strerror(errno) << endl;
+        return false;
+    }
+    refresh(*root, true);
+    return true;
+}
+
+bool TreeWatcher::read_events() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t bytes_read = read(inotify_fd, buffer, sizeof(buffer));
+        if (bytes_read < 0 && errno == EINTR) continue;
+        if (bytes_read <= 0) return true;
+        for (char* cursor = buffer; cursor < buffer + bytes_read;) {
+            auto* event = reinterpret_cast<inotify_event*>(cursor);
+            cursor += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, so everything has to be read again
+                changed[root->watch] = true;
+                continue;
+            }
+            auto directory = watched.find(event->wd);
+            if (directory == watched.end()) continue;
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                if (directory->second == root.get()) return false;
+                continue; // The parent reports the removal
+            }
+            // A watched subdirectory's own attributes also reach its parent, by name
+            if ((event->mask & IN_ATTRIB) && !event->len) continue;
+            string_view name = event->len ? string_view(event->name) : string_view();
+            bool rules_changed = options.use_gitignore && name == ".gitignore";
+            // Writes to plain files only matter for .gitignore rules and
+            // for the sizes and times of formats that show them
+            if ((event->mask & IN_CLOSE_WRITE) && !rules_changed && !options.metadata_fields)
+                continue;
+            bool& reload_subtree = changed[event->wd];
+            reload_subtree = reload_subtree || rules_changed;
+            // The directory's own size and time are in its parent's listing;
+            // an entry's attributes leave them alone
+            WatchedDirectory* parent = directory->second->parent;
+            if (options.metadata_fields && !(event->mask & (IN_CLOSE_WRITE | IN_ATTRIB)) && parent)
+                changed.try_emplace(parent->watch, false);
+        }
+    }
+}
+
+void TreeWatcher::apply_changes() {
+    for (const auto& [watch, reload_subtree] : changed) {
+        // Directories dropped by an earlier refresh of this batch are gone
+        auto directory = watched.find(watch);
+        if (directory != watched.end())
+            refresh(*directory->second, reload_subtree);
+    }
+    changed.clear();
+}
+
+const WatchedDirectory* TreeWatcher::find(string_view relative_path) const {
+    const WatchedDirectory* directory = root.get();
+    while (directory && !relative_path.empty()) {
+        size_t separator = relative_path.find('/');
+        string_view component = relative_path.substr(0, separator);
+        relative_path = (separator == string_view::npos)
+            ? string_view() : relative_path.substr(separator + 1);
+        if (component.empty() || component == ".") continue;
+        const WatchedDirectory* next = nullptr;
+        size_t subdirectory_index = 0;
+        for (const auto& entry : directory->listing.entries) {
+            if (!entry.is_directory()) continue;
+            if (entry.name == component) {
+                next = directory->subdirectories[subdirectory_index].get();
+                break;
+            }
+            subdirectory_index++;
+        }
+        directory = next;
+    }
+    return directory;
+}
+
+void TreeWatcher::render_entries(
+    const WatchedDirectory& directory,
+    const HierarchyOptions& render_options,
+    HierarchyState& state,
+    unsigned int depth
+) const {
+    // The directories being printed, from the given one down
+    vector<const WatchedDirectory*> path = {&directory};
+    process_directory_entries(directory.listing, state, depth + 1,
+        [&](const ListedEntry&, size_t index) -> const DirectoryListing* {
+            const auto& subdirectory = path.back()->subdirectories[index];
+            if (!subdirectory || !lists_entries_at(render_options, depth + path.size()))
+                return nullptr;
+            path.push_back(subdirectory.get());
+            return &subdirectory->listing;
+        },
+        [&] { path.pop_back(); }
+    );
+}
+
+namespace {
+
+/**
+ * @brief Reprints the whole tree from memory, over the previous one on a terminal.
+ */
+void render_tree(
+    const TreeWatcher& watcher,
+    const HierarchyOptions& options,
+    OutputFormat format,
+    OutputBuffer& output
+) {
+    if (format == OutputFormat::TEXT && output.is_interactive())
+        output.write("\033[H\033[2J");
+    std::unique_ptr<TreeEmitter> emitter = make_tree_emitter(format, output, options);
+    HierarchyState state(*emitter);
+    state.directory_count = 1;
+    print_directory_header(watcher.root_directory().name, state, 0);
+    watcher.render_entries(watcher.root_directory(), options, state, 0);
+    print_summary(state);
+    output.flush();
+}
+
+/**
+ * @brief Waits for a batch of events to end.
+ *
+ * @return false if the root directory itself went away.
+ */
+bool wait_for_batch(TreeWatcher& watcher) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point batch_end;
+    while (true) {
+        int timeout_ms = -1;
+        if (watcher.has_changes()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                batch_end - Clock::now()
+            ).count();
+            if (remaining <= 0) return true;
+            timeout_ms = static_cast<int>(std::min<long long>(remaining, QUIET_PERIOD_MS));
+        }
+        pollfd descriptor = {watcher.descriptor(), POLLIN, 0};
+        int ready = poll(&descriptor, 1, timeout_ms);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return true; // Quiet period elapsed
+        bool batch_started = watcher.has_changes();
+        if (!watcher.read_events()) return false;
+        if (!batch_started && watcher.has_changes())
+            batch_end = Clock::now() + std::chrono::milliseconds(MAX_BATCH_MS);
+    }
+}
+
+}
+
+#endif
+
+int watch_directory_hierarchy(
+    const string& path,
+    const HierarchyOptions& options,
+    OutputFormat format,
+    OutputBuffer& output
+) {
+#ifdef __linux__
+    TreeWatcher watcher(options);
+    if (!watcher.start(path)) return 1;
+    render_tree(watcher, options, format, output);
+    while (true) {
+        if (!wait_for_batch(watcher)) {
+            cerr << "Error: " << path << " was removed or moved." << endl;
+            return 1;
+        }
+        watcher.apply_changes();
+        render_tree(watcher, options, format, output);
+    }
+#else
+    (void)path;
+    (void)options;
+    (void)format;
+    (void)output;
+    cerr << "Error: --watch is not supported on this platform." << endl;
+    return 1;
+#endif
+}
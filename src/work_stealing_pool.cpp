@@ -0,0 +1,113 @@
+#include "../include/work_stealing_pool.hpp"
+
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+namespace {
+
+// Pool and deque index of the current thread when it is a pool worker.
+thread_local WorkStealingPool* current_pool = nullptr;
+thread_local unsigned int current_index = 0;
+
+}
+
+/**
+ * @brief Starts the worker threads.
+ *
+ * @param thread_count The number of workers; at least one is started.
+ */
+WorkStealingPool::WorkStealingPool(unsigned int thread_count) {
+    if (thread_count == 0) thread_count = 1;
+    for (unsigned int i = 0; i < thread_count; i++)
+        queues.push_back(std::make_unique<WorkerQueue>());
+    for (unsigned int i = 0; i < thread_count; i++)
+        workers.emplace_back([this, i] { worker_loop(i); });
+}
+
+/**
+ * @brief Stops and joins the workers. Tasks still queued are discarded.
+ *
+ * Workers finish the task they are running; whatever it queues is dropped
+ * as well, so an aborted walk does not read the rest of the tree first.
+ */
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard<mutex> lock(idle_mutex);
+        stopping.store(true, std::memory_order_relaxed);
+    }
+    idle_condition.notify_all();
+    for (auto& queue : queues) {
+        std::deque<Task> dropped;
+        {
+            lock_guard<mutex> lock(queue->mutex);
+            dropped.swap(queue->tasks);
+        }
+        pending_count.fetch_sub(dropped.size(), std::memory_order_relaxed);
+    }
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void WorkStealingPool::submit(Task task) {
+    unsigned int index = (current_pool == this)
+        ? current_index
+        : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    {
+        lock_guard<mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    pending_count.fetch_add(1, std::memory_order_release);
+    // Taking the idle mutex orders the wake-up after a sleeper's predicate check
+    { lock_guard<mutex> lock(idle_mutex); }
+    idle_condition.notify_one();
+}
+
+/**
+ * @brief Takes the newest task from the back of a worker's own deque.
+ */
+bool WorkStealingPool::pop_local(unsigned int index, Task& task) {
+    WorkerQueue& queue = *queues[index];
+    lock_guard<mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    pending_count.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Takes the oldest task from the front of another worker's deque.
+ */
+bool WorkStealingPool::steal(unsigned int thief, Task& task) {
+    for (size_t offset = 1; offset <= queues.size(); offset++) {
+        WorkerQueue& queue = *queues[(thief + offset) % queues.size()];
+        lock_guard<mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        pending_count.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::worker_loop(unsigned int index) {
+    current_pool = this;
+    current_index = index;
+    while (true) {
+        Task task;
+        if (pop_local(index, task) || steal(index, task)) {
+            if (stopping.load(std::memory_order_relaxed)) continue;
+            task();
+            continue;
+        }
+        // Sleep until new work arrives or the pool shuts down
+        unique_lock<mutex> lock(idle_mutex);
+        idle_condition.wait(lock, [this] {
+            return stopping.load(std::memory_order_relaxed)
+                || pending_count.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping.load(std::memory_order_relaxed)) return;
+    }
+}